@@ -0,0 +1,19 @@
+#include "batch.h"
+
+
+void batch_t::addRect(int x, int y, int w, int h, const rgba_t &color) {
+    const float x1 = float(x);
+    const float y1 = float(y);
+    const float x2 = float(x + w);
+    const float y2 = float(y + h);
+
+    quads.push_back({x1, y1, color});
+    quads.push_back({x1, y2, color});
+    quads.push_back({x2, y2, color});
+    quads.push_back({x2, y1, color});
+}
+
+void batch_t::addLine(int x1, int y1, int x2, int y2, const rgba_t &color) {
+    lines.push_back({float(x1), float(y1), color});
+    lines.push_back({float(x2), float(y2), color});
+}
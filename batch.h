@@ -0,0 +1,44 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <vector>
+
+
+struct rgba_t {
+    unsigned char r {0};
+    unsigned char g {0};
+    unsigned char b {0};
+    unsigned char a {255};
+};
+
+struct batch_vertex_t {
+    float x {0.0f};
+    float y {0.0f};
+    rgba_t color;
+};
+
+// Collects primitives for a frame so each kind can be submitted in one pass
+// instead of interleaving quads and lines per entity.
+struct batch_t {
+    std::vector<batch_vertex_t> quads; // 4 vertices per quad, counter-clockwise from top-left
+    std::vector<batch_vertex_t> lines; // 2 vertices per line
+
+    inline void clear() {
+        quads.clear();
+        lines.clear();
+    }
+
+    inline int quadCount() const {
+        return int(quads.size() / 4);
+    }
+
+    inline int lineCount() const {
+        return int(lines.size() / 2);
+    }
+
+    void addRect(int x, int y, int w, int h, const rgba_t &color);
+    void addLine(int x1, int y1, int x2, int y2, const rgba_t &color);
+};
+
+
+#endif//__BATCH_H__
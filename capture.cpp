@@ -0,0 +1,183 @@
+#include "capture.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace {
+    void encoderLoop(frame_capture_t &capture) {
+        const int slot_count = int(capture.slots.size());
+
+        for (;;) {
+            capture_slot_t *slot;
+            {
+                std::unique_lock<std::mutex> lock(capture.mutex);
+                capture.queued.wait(lock, [&capture] {
+                    return capture.stopping || capture.slots[capture.next_encode].state == capture_queued;
+                });
+
+                // Drain whatever is still queued before leaving.
+                slot = &capture.slots[capture.next_encode];
+                if (slot->state != capture_queued) {
+                    return;
+                }
+
+                slot->state = capture_encoding;
+                capture.next_encode = (capture.next_encode + 1) % slot_count;
+            }
+
+            char path[1024];
+            snprintf(path, sizeof(path), "%s%05d.png", capture.prefix.c_str(), slot->sequence);
+            const bool saved = tigrSaveImageEx(path, slot->bitmap, &capture.save_options) != 0;
+
+            {
+                std::lock_guard<std::mutex> lock(capture.mutex);
+                slot->state = capture_free;
+                if (saved) {
+                    capture.written += 1;
+                } else {
+                    capture.failed += 1;
+                }
+            }
+            capture.released.notify_one();
+        }
+    }
+}
+
+bool startCapture(frame_capture_t &capture, const std::string &prefix, int width, int height,
+                  int threads, int slots, bool drop_when_full, int level) {
+    stopCapture(capture);
+
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (slots < 1) {
+        slots = threads * 2;
+    }
+
+    capture.slots.resize(slots);
+    for (auto &slot : capture.slots) {
+        slot.bitmap = tigrBitmap(width, height);
+        if (!slot.bitmap) {
+            stopCapture(capture);
+            return false;
+        }
+    }
+
+    capture.prefix = prefix;
+    capture.drop_when_full = drop_when_full;
+    capture.save_options.level = level;
+    capture.next_slot = 0;
+    capture.next_encode = 0;
+    capture.stopping = false;
+    capture.captured = 0;
+    capture.written = 0;
+    capture.failed = 0;
+    capture.dropped = 0;
+    capture.delayed = 0;
+    capture.delay_seconds = 0.0;
+
+    for (int i = 0; i < threads; i += 1) {
+        capture.threads.emplace_back(encoderLoop, std::ref(capture));
+    }
+
+    return true;
+}
+
+bool captureFrame(frame_capture_t &capture, const Tigr *bmp, int frame) {
+    if (capture.slots.empty()) {
+        return false;
+    }
+
+    capture_slot_t *slot;
+    {
+        std::unique_lock<std::mutex> lock(capture.mutex);
+        slot = &capture.slots[capture.next_slot];
+
+        if (slot->state != capture_free) {
+            if (capture.drop_when_full) {
+                capture.dropped += 1;
+                return false;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            capture.released.wait(lock, [slot] {
+                return slot->state == capture_free;
+            });
+            const auto end = std::chrono::steady_clock::now();
+
+            capture.delayed += 1;
+            capture.delay_seconds += std::chrono::duration<double>(end - start).count();
+        }
+    }
+
+    // The slot is ours until it is queued, encoders only touch queued slots.
+    Tigr *copy = slot->bitmap;
+    const int w = bmp->w < copy->w ? bmp->w : copy->w;
+    const int h = bmp->h < copy->h ? bmp->h : copy->h;
+    for (int y = 0; y < h; y += 1) {
+        std::memcpy(copy->pix + y * copy->stride, bmp->pix + y * bmp->stride, w * sizeof(TPixel));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        slot->sequence = frame;
+        slot->state = capture_queued;
+        capture.next_slot = (capture.next_slot + 1) % int(capture.slots.size());
+        capture.captured += 1;
+    }
+    capture.queued.notify_all();
+
+    return true;
+}
+
+bool saveImageOnWorkers(worker_pool_t &pool, const char *path, Tigr *bmp, const TigrSaveOptions &options) {
+    TigrSaveJob *job = tigrSaveBegin(bmp, &options, pool.workerCount());
+    if (!job) {
+        return false;
+    }
+
+    const int segments = tigrSaveSegments(job);
+    const int workers = pool.workerCount();
+    runOnWorkers(pool, [job, segments, workers] (int worker) {
+        for (int i = worker; i < segments; i += workers) {
+            tigrSaveSegment(job, i);
+        }
+    });
+
+    int length = 0;
+    void *png = tigrSaveEnd(job, &length);
+    if (!png) {
+        return false;
+    }
+
+    FILE *file = std::fopen(path, "wb");
+    bool saved = file && std::fwrite(png, 1, length, file) == size_t(length);
+    if (file) {
+        saved = std::fclose(file) == 0 && saved;
+    }
+    std::free(png);
+    return saved;
+}
+
+void stopCapture(frame_capture_t &capture) {
+    {
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        capture.stopping = true;
+    }
+    capture.queued.notify_all();
+
+    for (auto &thread : capture.threads) {
+        thread.join();
+    }
+    capture.threads.clear();
+
+    for (auto &slot : capture.slots) {
+        if (slot.bitmap) {
+            tigrFree(slot.bitmap);
+        }
+    }
+    capture.slots.clear();
+}
@@ -0,0 +1,72 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tigr.h"
+#include "workers.h"
+
+
+enum capture_state_t {
+    capture_free,
+    capture_queued,
+    capture_encoding,
+};
+
+// One reusable copy of a frame waiting for, or going through, an encoder.
+struct capture_slot_t {
+    Tigr *bitmap {nullptr};
+    capture_state_t state {capture_free};
+    int sequence {0};
+};
+
+// Records frames as a numbered PNG sequence without stalling the caller.
+// Frames are copied into a ring of slots and encoded with tigrSaveImageEx by
+// a pool of threads, oldest first. Files are named after the frame number the
+// caller passes in, so a dropped frame leaves a gap in the sequence.
+struct frame_capture_t {
+    std::string prefix;
+    bool drop_when_full {false};
+    TigrSaveOptions save_options {6};
+
+    std::vector<capture_slot_t> slots;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable queued;    // wakes encoders
+    std::condition_variable released;  // wakes the producer waiting for a slot
+    int next_slot {0};      // where the next frame goes, the ring is filled in order
+    int next_encode {0};    // oldest queued slot
+    bool stopping {false};
+
+    // Back-pressure counters, read them after stopCapture or under the mutex.
+    int captured {0};   // frames handed to the encoders
+    int written {0};    // files written successfully
+    int failed {0};     // tigrSaveImage errors
+    int dropped {0};    // frames skipped because the ring was full
+    int delayed {0};    // frames that had to wait for a free slot
+    double delay_seconds {0.0};
+};
+
+// slots = 0 picks two slots per encoder thread. level is the PNG
+// compression level, see TigrSaveOptions.
+bool startCapture(frame_capture_t &capture, const std::string &prefix, int width, int height,
+                  int threads, int slots = 0, bool drop_when_full = false, int level = 6);
+
+// Copies bmp into the next free slot to be written as prefix + frame.
+// Blocks while the ring is full unless the capture drops frames, returns
+// false when the frame was dropped.
+bool captureFrame(frame_capture_t &capture, const Tigr *bmp, int frame);
+
+// Finishes every queued frame, then joins the encoders and frees the slots.
+void stopCapture(frame_capture_t &capture);
+
+// Saves one PNG with its rows split into a segment per worker, for when a
+// single frame has to be written as fast as possible.
+bool saveImageOnWorkers(worker_pool_t &pool, const char *path, Tigr *bmp, const TigrSaveOptions &options);
+
+
+#endif//__CAPTURE_H__
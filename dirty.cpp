@@ -0,0 +1,76 @@
+#include <algorithm>
+
+#include "dirty.h"
+
+
+void initDirtyGrid(dirty_grid_t &grid, int width, int height, int cell_size) {
+    grid.cell_size = cell_size;
+    grid.width = width;
+    grid.height = height;
+    grid.columns = (width + cell_size - 1) / cell_size;
+    grid.rows = (height + cell_size - 1) / cell_size;
+    grid.current.assign(grid.cellCount(), 0);
+    grid.previous.assign(grid.cellCount(), 0);
+    grid.everything = true;
+}
+
+void markDirty(dirty_grid_t &grid, int min_x, int min_y, int max_x, int max_y) {
+    min_x = std::max(min_x, 0);
+    min_y = std::max(min_y, 0);
+    max_x = std::min(max_x, grid.width - 1);
+    max_y = std::min(max_y, grid.height - 1);
+    if (min_x > max_x || min_y > max_y) {
+        return;
+    }
+
+    const int size = grid.cell_size;
+    for (int row = min_y / size; row <= max_y / size; row += 1) {
+        unsigned char *cells = &grid.current[row * grid.columns];
+        std::fill(cells + min_x / size, cells + max_x / size + 1, 1);
+    }
+}
+
+void invalidateDirtyGrid(dirty_grid_t &grid) {
+    grid.everything = true;
+}
+
+int forEachDirtySpan(const dirty_grid_t &grid, const std::function<void(int, int, int, int)> &span) {
+    if (grid.everything) {
+        span(0, 0, grid.width, grid.height);
+        return grid.cellCount();
+    }
+
+    const int size = grid.cell_size;
+    int dirty = 0;
+
+    for (int row = 0; row < grid.rows; row += 1) {
+        const unsigned char *current = &grid.current[row * grid.columns];
+        const unsigned char *previous = &grid.previous[row * grid.columns];
+        const int y = row * size;
+        const int h = std::min(size, grid.height - y);
+
+        for (int column = 0; column < grid.columns;) {
+            if (!(current[column] | previous[column])) {
+                column += 1;
+                continue;
+            }
+
+            const int first = column;
+            while (column < grid.columns && (current[column] | previous[column])) {
+                column += 1;
+            }
+
+            const int x = first * size;
+            span(x, y, std::min(column * size, grid.width) - x, h);
+            dirty += column - first;
+        }
+    }
+
+    return dirty;
+}
+
+void nextDirtyFrame(dirty_grid_t &grid) {
+    grid.previous.swap(grid.current);
+    std::fill(grid.current.begin(), grid.current.end(), 0);
+    grid.everything = false;
+}
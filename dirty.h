@@ -0,0 +1,41 @@
+#ifndef __DIRTY_H__
+#define __DIRTY_H__
+
+#include <functional>
+#include <vector>
+
+
+// Coarse record of which parts of a persistent framebuffer were drawn over.
+// Cells touched this frame or the one before are the only ones that need
+// restoring and redrawing; everything else still holds the right pixels.
+struct dirty_grid_t {
+    int cell_size {16};
+    int width {0};
+    int height {0};
+    int columns {0};
+    int rows {0};
+
+    std::vector<unsigned char> current;  // drawn over this frame
+    std::vector<unsigned char> previous; // drawn over last frame
+    bool everything {true};              // the whole buffer has to be restored
+
+    inline int cellCount() const {
+        return columns * rows;
+    }
+};
+
+void initDirtyGrid(dirty_grid_t &grid, int width, int height, int cell_size = 16);
+
+// Marks the inclusive pixel bounds [min_x, max_x] x [min_y, max_y].
+void markDirty(dirty_grid_t &grid, int min_x, int min_y, int max_x, int max_y);
+void invalidateDirtyGrid(dirty_grid_t &grid);
+
+// Calls span(x, y, w, h) for each horizontal run of cells dirty in either
+// frame, clipped to the buffer. Returns the number of dirty cells.
+int forEachDirtySpan(const dirty_grid_t &grid, const std::function<void(int, int, int, int)> &span);
+
+// This frame's marks become last frame's.
+void nextDirtyFrame(dirty_grid_t &grid);
+
+
+#endif//__DIRTY_H__
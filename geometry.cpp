@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cmath>
+
+#include "geometry.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GEOMETRY_SSE2
+#include <emmintrin.h>
+#endif
+
+
+const rgba_t background_color {127, 127, 127, 255};
+const rgba_t border_color {64, 64, 64, 255};
+
+namespace {
+    const rgba_t grid_color {148, 148, 148, 255};
+    const rgba_t crosshair_color {123, 175, 201, 255};
+    const rgba_t arrow_color {213, 246, 221, 255};
+
+    const rgba_t missile_live_color {255, 255, 0, 255};
+    const rgba_t missile_dead_color {37, 221, 245, 255};
+    const rgba_t missile_line_color {192, 192, 192, 255};
+    const rgba_t smoke_color {178, 178, 178, 255};
+    const rgba_t spark_color {255, 255, 255, 255};
+    const rgba_t spark_quad_color {190, 120, 0, 255};
+
+    const float missile_half_size = 2.0f;
+    const float missile_tail_length = 16.0f;
+
+    const float smoke_min_size = 2.0f;
+    const float smoke_max_size = 8.0f;
+
+    // A spark streak is 12px long at 200px/s and shorter below that, so the
+    // offset is -v * min(12 / 200, 12 / |v|) with a single square root.
+    const float spark_streak_scale = 12.0f / 200.0f;
+    const float spark_streak_length = 12.0f;
+    const float spark_size = 2.0f;
+
+    inline void putQuad(batch_vertex_t *q, float x1, float y1, float x2, float y2, const rgba_t &color) {
+        q[0] = {x1, y1, color};
+        q[1] = {x1, y2, color};
+        q[2] = {x2, y2, color};
+        q[3] = {x2, y1, color};
+    }
+
+    inline void putLine(batch_vertex_t *l, float x1, float y1, float x2, float y2, const rgba_t &color) {
+        l[0] = {x1, y1, color};
+        l[1] = {x2, y2, color};
+    }
+
+    // Bounds are inclusive on both ends, so an entity touching the view edge
+    // is kept; a pixel too many is cheaper than a missing one.
+    inline bool visible(const cull_rect_t &view, float x1, float y1, float x2, float y2) {
+        return x2 >= view.x1 && x1 <= view.x2 && y2 >= view.y1 && y1 <= view.y2;
+    }
+
+#ifdef GEOMETRY_SSE2
+    inline __m128 truncate(__m128 v) {
+        return _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    }
+
+    // Lane indices for the block starting at i. Lanes past the end repeat the
+    // last entity so loads stay in bounds; their results are never written.
+    inline void laneIndices(int i, int count, int lanes[4]) {
+        for (int k = 0; k < 4; k += 1) {
+            lanes[k] = std::min(i + k, count - 1);
+        }
+    }
+
+    struct cull_lanes_t {
+        __m128 x1, y1, x2, y2;
+    };
+
+    inline cull_lanes_t splatView(const cull_rect_t &view) {
+        return {_mm_set1_ps(view.x1), _mm_set1_ps(view.y1), _mm_set1_ps(view.x2), _mm_set1_ps(view.y2)};
+    }
+
+    inline int visibleMask(const cull_lanes_t &view, __m128 x1, __m128 y1, __m128 x2, __m128 y2) {
+        const __m128 in_x = _mm_and_ps(_mm_cmpge_ps(x2, view.x1), _mm_cmple_ps(x1, view.x2));
+        const __m128 in_y = _mm_and_ps(_mm_cmpge_ps(y2, view.y1), _mm_cmple_ps(y1, view.y2));
+        return _mm_movemask_ps(_mm_and_ps(in_x, in_y));
+    }
+
+    #define GATHER(ITEMS, LANES, FIELD) \
+        _mm_set_ps(ITEMS[LANES[3]].FIELD, ITEMS[LANES[2]].FIELD, ITEMS[LANES[1]].FIELD, ITEMS[LANES[0]].FIELD)
+#endif
+}
+
+void buildMissileGeometry(const std::vector<missile_t> &missiles, const cull_rect_t &view,
+                          batch_t &batch, cull_stats_t &stats) {
+    const int count = int(missiles.size());
+    if (count == 0) {
+        return;
+    }
+
+    const size_t quad_base = batch.quads.size();
+    const size_t line_base = batch.lines.size();
+    batch.quads.resize(quad_base + size_t(count) * 4);
+    batch.lines.resize(line_base + size_t(count) * 2);
+
+    const missile_t *m = missiles.data();
+    batch_vertex_t *quads = batch.quads.data() + quad_base;
+    batch_vertex_t *lines = batch.lines.data() + line_base;
+    int kept = 0;
+
+#ifdef GEOMETRY_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 tail = _mm_set1_ps(-missile_tail_length);
+    const __m128 half_size = _mm_set1_ps(missile_half_size);
+    const cull_lanes_t view_lanes = splatView(view);
+
+    for (int i = 0; i < count; i += 4) {
+        int lanes[4];
+        laneIndices(i, count, lanes);
+
+        const __m128 px = GATHER(m, lanes, position.x);
+        const __m128 py = GATHER(m, lanes, position.y);
+        const __m128 vx = GATHER(m, lanes, velocity.x);
+        const __m128 vy = GATHER(m, lanes, velocity.y);
+        const __m128 life = GATHER(m, lanes, life);
+
+        const __m128 x = truncate(px);
+        const __m128 y = truncate(py);
+
+        const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+        const __m128 scale = _mm_and_ps(_mm_cmpgt_ps(len, zero), _mm_div_ps(tail, len));
+        const __m128 tx = _mm_add_ps(x, truncate(_mm_mul_ps(vx, scale)));
+        const __m128 ty = _mm_add_ps(y, truncate(_mm_mul_ps(vy, scale)));
+        const int dead = _mm_movemask_ps(_mm_cmplt_ps(life, zero));
+
+        // The body quad and the tail line together.
+        const int keep = visibleMask(view_lanes,
+                                     _mm_min_ps(_mm_sub_ps(x, half_size), tx),
+                                     _mm_min_ps(_mm_sub_ps(y, half_size), ty),
+                                     _mm_max_ps(_mm_add_ps(x, half_size), tx),
+                                     _mm_max_ps(_mm_add_ps(y, half_size), ty));
+        if (keep == 0) {
+            continue;
+        }
+
+        alignas(16) float xs[4], ys[4], txs[4], tys[4];
+        _mm_store_ps(xs, x);
+        _mm_store_ps(ys, y);
+        _mm_store_ps(txs, tx);
+        _mm_store_ps(tys, ty);
+
+        const int n = std::min(4, count - i);
+        for (int k = 0; k < n; k += 1) {
+            if (((keep >> k) & 1) == 0) {
+                continue;
+            }
+
+            const rgba_t &color = ((dead >> k) & 1) ? missile_dead_color : missile_live_color;
+            putQuad(quads + kept * 4,
+                    xs[k] - missile_half_size, ys[k] - missile_half_size,
+                    xs[k] + missile_half_size, ys[k] + missile_half_size, color);
+            putLine(lines + kept * 2, xs[k], ys[k], txs[k], tys[k], missile_line_color);
+            kept += 1;
+        }
+    }
+#else
+    for (int i = 0; i < count; i += 1) {
+        const float x = std::trunc(m[i].position.x);
+        const float y = std::trunc(m[i].position.y);
+        const float len = m[i].velocity.distance();
+        const float scale = len > 0.0f ? -missile_tail_length / len : 0.0f;
+        const float tx = x + std::trunc(m[i].velocity.x * scale);
+        const float ty = y + std::trunc(m[i].velocity.y * scale);
+        const rgba_t &color = m[i].life < 0.0f ? missile_dead_color : missile_live_color;
+
+        if (!visible(view,
+                     std::min(x - missile_half_size, tx), std::min(y - missile_half_size, ty),
+                     std::max(x + missile_half_size, tx), std::max(y + missile_half_size, ty))) {
+            continue;
+        }
+
+        putQuad(quads + kept * 4,
+                x - missile_half_size, y - missile_half_size,
+                x + missile_half_size, y + missile_half_size, color);
+        putLine(lines + kept * 2, x, y, tx, ty, missile_line_color);
+        kept += 1;
+    }
+#endif
+
+    batch.quads.resize(quad_base + size_t(kept) * 4);
+    batch.lines.resize(line_base + size_t(kept) * 2);
+    stats.drawn += kept;
+    stats.culled += count - kept;
+}
+
+void buildMissileParticleGeometry(const std::vector<missile_particle_t> &particles, const cull_rect_t &view,
+                                  batch_t &batch, cull_stats_t &stats) {
+    const int count = int(particles.size());
+    if (count == 0) {
+        return;
+    }
+
+    const size_t quad_base = batch.quads.size();
+    batch.quads.resize(quad_base + size_t(count) * 4);
+
+    const missile_particle_t *p = particles.data();
+    batch_vertex_t *quads = batch.quads.data() + quad_base;
+    int kept = 0;
+
+#ifdef GEOMETRY_SSE2
+    const __m128 min_size = _mm_set1_ps(smoke_min_size);
+    const __m128 size_range = _mm_set1_ps(smoke_max_size - smoke_min_size);
+    const cull_lanes_t view_lanes = splatView(view);
+
+    for (int i = 0; i < count; i += 4) {
+        int lanes[4];
+        laneIndices(i, count, lanes);
+
+        const __m128 px = GATHER(p, lanes, position.x);
+        const __m128 py = GATHER(p, lanes, position.y);
+        const __m128 time = GATHER(p, lanes, time);
+        const __m128 life = GATHER(p, lanes, life);
+
+        // w = min + int((time / life) * (max - min)), the rect starts w / 2 up and left.
+        const __m128i w = _mm_cvttps_epi32(_mm_add_ps(min_size, truncate(_mm_mul_ps(_mm_div_ps(time, life), size_range))));
+        const __m128i half = _mm_srai_epi32(w, 1);
+        const __m128 x1 = _mm_sub_ps(truncate(px), _mm_cvtepi32_ps(half));
+        const __m128 y1 = _mm_sub_ps(truncate(py), _mm_cvtepi32_ps(half));
+        const __m128 x2 = _mm_add_ps(x1, _mm_cvtepi32_ps(w));
+        const __m128 y2 = _mm_add_ps(y1, _mm_cvtepi32_ps(w));
+
+        const int keep = visibleMask(view_lanes, x1, y1, x2, y2);
+        if (keep == 0) {
+            continue;
+        }
+
+        alignas(16) float x1s[4], y1s[4], x2s[4], y2s[4];
+        _mm_store_ps(x1s, x1);
+        _mm_store_ps(y1s, y1);
+        _mm_store_ps(x2s, x2);
+        _mm_store_ps(y2s, y2);
+
+        const int n = std::min(4, count - i);
+        for (int k = 0; k < n; k += 1) {
+            if (((keep >> k) & 1) == 0) {
+                continue;
+            }
+
+            putQuad(quads + kept * 4, x1s[k], y1s[k], x2s[k], y2s[k], smoke_color);
+            kept += 1;
+        }
+    }
+#else
+    for (int i = 0; i < count; i += 1) {
+        const int w = int(smoke_min_size) + int((p[i].time / p[i].life) * (smoke_max_size - smoke_min_size));
+        const float x1 = std::trunc(p[i].position.x) - float(w / 2);
+        const float y1 = std::trunc(p[i].position.y) - float(w / 2);
+
+        if (!visible(view, x1, y1, x1 + float(w), y1 + float(w))) {
+            continue;
+        }
+
+        putQuad(quads + kept * 4, x1, y1, x1 + float(w), y1 + float(w), smoke_color);
+        kept += 1;
+    }
+#endif
+
+    batch.quads.resize(quad_base + size_t(kept) * 4);
+    stats.drawn += kept;
+    stats.culled += count - kept;
+}
+
+void buildExplosionParticleGeometry(const std::vector<explosion_particle_t> &particles, const cull_rect_t &view,
+                                    batch_t &batch, cull_stats_t &stats) {
+    const int count = int(particles.size());
+    if (count == 0) {
+        return;
+    }
+
+    const size_t quad_base = batch.quads.size();
+    const size_t line_base = batch.lines.size();
+    batch.quads.resize(quad_base + size_t(count) * 4);
+    batch.lines.resize(line_base + size_t(count) * 2);
+
+    const explosion_particle_t *p = particles.data();
+    batch_vertex_t *quads = batch.quads.data() + quad_base;
+    batch_vertex_t *lines = batch.lines.data() + line_base;
+
+    const float half = spark_size / 2.0f;
+    int kept = 0;
+
+#ifdef GEOMETRY_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 streak_scale = _mm_set1_ps(-spark_streak_scale);
+    const __m128 streak_length = _mm_set1_ps(-spark_streak_length);
+    const __m128 half_size = _mm_set1_ps(half);
+    const cull_lanes_t view_lanes = splatView(view);
+
+    for (int i = 0; i < count; i += 4) {
+        int lanes[4];
+        laneIndices(i, count, lanes);
+
+        const __m128 px = GATHER(p, lanes, position.x);
+        const __m128 py = GATHER(p, lanes, position.y);
+        const __m128 vx = GATHER(p, lanes, velocity.x);
+        const __m128 vy = GATHER(p, lanes, velocity.y);
+
+        const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+        const __m128 scale = _mm_and_ps(_mm_cmpgt_ps(len, zero),
+                                        _mm_max_ps(streak_scale, _mm_div_ps(streak_length, len)));
+
+        const __m128 x1 = truncate(px);
+        const __m128 y1 = truncate(py);
+        const __m128 x2 = truncate(_mm_add_ps(px, _mm_mul_ps(vx, scale)));
+        const __m128 y2 = truncate(_mm_add_ps(py, _mm_mul_ps(vy, scale)));
+
+        // The streak and the quad at its head together.
+        const int keep = visibleMask(view_lanes,
+                                     _mm_min_ps(_mm_sub_ps(x1, half_size), x2),
+                                     _mm_min_ps(_mm_sub_ps(y1, half_size), y2),
+                                     _mm_max_ps(_mm_add_ps(x1, half_size), x2),
+                                     _mm_max_ps(_mm_add_ps(y1, half_size), y2));
+        if (keep == 0) {
+            continue;
+        }
+
+        alignas(16) float x1s[4], y1s[4], x2s[4], y2s[4];
+        _mm_store_ps(x1s, x1);
+        _mm_store_ps(y1s, y1);
+        _mm_store_ps(x2s, x2);
+        _mm_store_ps(y2s, y2);
+
+        const int n = std::min(4, count - i);
+        for (int k = 0; k < n; k += 1) {
+            if (((keep >> k) & 1) == 0) {
+                continue;
+            }
+
+            const float qx = x1s[k] - half;
+            const float qy = y1s[k] - half;
+
+            putLine(lines + kept * 2, x1s[k], y1s[k], x2s[k], y2s[k], spark_color);
+            putQuad(quads + kept * 4, qx, qy, qx + spark_size, qy + spark_size, spark_quad_color);
+            kept += 1;
+        }
+    }
+#else
+    for (int i = 0; i < count; i += 1) {
+        const float len = p[i].velocity.distance();
+        const float scale = len > 0.0f ? -std::min(spark_streak_scale, spark_streak_length / len) : 0.0f;
+
+        const float x1 = std::trunc(p[i].position.x);
+        const float y1 = std::trunc(p[i].position.y);
+        const float x2 = std::trunc(p[i].position.x + p[i].velocity.x * scale);
+        const float y2 = std::trunc(p[i].position.y + p[i].velocity.y * scale);
+        const float qx = x1 - half;
+        const float qy = y1 - half;
+
+        if (!visible(view, std::min(qx, x2), std::min(qy, y2), std::max(qx + spark_size, x2), std::max(qy + spark_size, y2))) {
+            continue;
+        }
+
+        putLine(lines + kept * 2, x1, y1, x2, y2, spark_color);
+        putQuad(quads + kept * 4, qx, qy, qx + spark_size, qy + spark_size, spark_quad_color);
+        kept += 1;
+    }
+#endif
+
+    batch.quads.resize(quad_base + size_t(kept) * 4);
+    batch.lines.resize(line_base + size_t(kept) * 2);
+    stats.drawn += kept;
+    stats.culled += count - kept;
+}
+
+void buildGridGeometry(int width, int height, int grid_size, batch_t &batch) {
+    const int half_width = width / 2;
+    const int half_height = height / 2;
+
+    const int grid_x_count = 2 * ((half_width / grid_size) + 1);
+    const int grid_y_count = 2 * ((half_height / grid_size) + 1);
+
+    const int start_x = half_width - ((grid_x_count / 2) * grid_size);
+    const int start_y = half_height - ((grid_y_count / 2) * grid_size);
+
+    for (int j = 0; j < grid_y_count; j += 1) {
+        const int y = start_y + (j * grid_size);
+
+        for (int i = 0; i < grid_x_count; i += 1) {
+            const int x = start_x + (i * grid_size);
+            const int c = (i + j) % 2;
+
+            if (c == 0) {
+                batch.addRect(x, y, grid_size, grid_size, grid_color);
+            }
+        }
+    }
+}
+
+void buildCrosshairGeometry(int width, int height, int x, int y, batch_t &batch) {
+    batch.addLine(x, 0, x, height, crosshair_color);
+    batch.addLine(0, y, width, y, crosshair_color);
+}
+
+void buildArrowGeometry(int width, int height, int x, int y, batch_t &batch) {
+    const int center_x = width / 2;
+    const int center_y = height / 2;
+
+    vec2_t v {float(x - center_x), float(y - center_y)};
+    v.setDistance(24.0f);
+
+    batch.addLine(center_x, center_y, center_x + static_cast<int>(v.x), center_y + static_cast<int>(v.y), arrow_color);
+}
+
+#ifdef GEOMETRY_SSE2
+#undef GATHER
+#endif
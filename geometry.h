@@ -0,0 +1,49 @@
+#ifndef __GEOMETRY_H__
+#define __GEOMETRY_H__
+
+#include <vector>
+
+#include "missiles.h"
+#include "batch.h"
+
+
+// The area entity geometry is built for, usually the render target.
+struct cull_rect_t {
+    float x1 {0.0f};
+    float y1 {0.0f};
+    float x2 {0.0f};
+    float y2 {0.0f};
+};
+
+// Entities kept and skipped by the builders, summed over a frame.
+struct cull_stats_t {
+    int drawn {0};
+    int culled {0};
+
+    inline void clear() {
+        drawn = 0;
+        culled = 0;
+    }
+};
+
+// Turns entity arrays straight into batch vertices, four entities at a time.
+// Output is appended to the batch's packed quad/line arrays so any backend
+// that consumes a batch_t can draw it. Entities whose bounds miss the view
+// are dropped here, before any draw command exists for them.
+void buildMissileGeometry(const std::vector<missile_t> &missiles, const cull_rect_t &view,
+                          batch_t &batch, cull_stats_t &stats);
+void buildMissileParticleGeometry(const std::vector<missile_particle_t> &particles, const cull_rect_t &view,
+                                  batch_t &batch, cull_stats_t &stats);
+void buildExplosionParticleGeometry(const std::vector<explosion_particle_t> &particles, const cull_rect_t &view,
+                                    batch_t &batch, cull_stats_t &stats);
+
+// Background and overlay content, shared by every backend.
+extern const rgba_t background_color;
+extern const rgba_t border_color;
+
+void buildGridGeometry(int width, int height, int grid_size, batch_t &batch);
+void buildCrosshairGeometry(int width, int height, int x, int y, batch_t &batch);
+void buildArrowGeometry(int width, int height, int x, int y, batch_t &batch);
+
+
+#endif//__GEOMETRY_H__
@@ -0,0 +1,327 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <spdlog/spdlog.h>
+
+#include "world.h"
+#include "random.h"
+#include "soft_render.h"
+#include "capture.h"
+
+
+// Runs the simulation with a scripted cursor and renders every frame on the
+// CPU into tigr bitmaps, without a window or GPU.
+//
+// usage: tigr-test-headless [--frames N] [--missiles N] [--seed N] [--threads N] [--png PREFIX]
+//                           [--encoders N] [--capture-slots N] [--drop-frames 0|1] [--png-level N]
+//                           [--present WxH] [--window ring[:N]|shm:NAME|file:PATH|x11]
+//
+// --threads 0 renders on the main thread, N > 0 uses the tiled rasterizer
+// with N workers.
+//
+// With --png, frames are encoded by --encoders background threads (0 saves
+// on the main thread, each frame split over the --threads workers). When
+// all --capture-slots are busy the loop waits, or skips the frame with
+// --drop-frames 1. --png-level picks the PNG compression level, 1 (fastest)
+// to 9 (smallest), default 6.
+//
+// --present scales every frame to a WxH bitmap the way a CPU-only window
+// would, and that bitmap is what gets saved.
+//
+// --window shows every frame in a tigr window too. With TIGR_HEADLESS it's
+// a null window: frames are kept in an N frame ring, published to a POSIX
+// shared memory segment, or appended to a raw BGRA file, and the cursor
+// script is played back as its input. With TIGR_X11, --window x11 opens a
+// real window and the missiles follow its mouse.
+
+namespace {
+    const int screen_width {800};
+    const int screen_height {600};
+
+    struct options_t {
+        int frames {600};
+        int missiles {1000};
+        unsigned seed {1};
+        int threads {0};
+        std::string png_prefix;
+        int encoders {2};
+        int capture_slots {0};
+        bool drop_frames {false};
+        int png_level {6};
+        int present_width {0};
+        int present_height {0};
+        std::string window;
+    };
+
+    bool parseOptions(int argc, char *argv[], options_t &options) {
+        for (int i = 1; i < argc; i += 1) {
+            const char *arg = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if (!value) {
+                spdlog::error("Missing value for {}", arg);
+                return false;
+            }
+
+            if (std::strcmp(arg, "--frames") == 0) {
+                options.frames = std::atoi(value);
+            } else if (std::strcmp(arg, "--missiles") == 0) {
+                options.missiles = std::atoi(value);
+            } else if (std::strcmp(arg, "--seed") == 0) {
+                options.seed = unsigned(std::strtoul(value, nullptr, 10));
+            } else if (std::strcmp(arg, "--threads") == 0) {
+                options.threads = std::atoi(value);
+            } else if (std::strcmp(arg, "--png") == 0) {
+                options.png_prefix = value;
+            } else if (std::strcmp(arg, "--encoders") == 0) {
+                options.encoders = std::atoi(value);
+            } else if (std::strcmp(arg, "--capture-slots") == 0) {
+                options.capture_slots = std::atoi(value);
+            } else if (std::strcmp(arg, "--drop-frames") == 0) {
+                options.drop_frames = std::atoi(value) != 0;
+            } else if (std::strcmp(arg, "--png-level") == 0) {
+                options.png_level = std::atoi(value);
+            } else if (std::strcmp(arg, "--present") == 0) {
+                if (std::sscanf(value, "%dx%d", &options.present_width, &options.present_height) != 2 ||
+                    options.present_width <= 0 || options.present_height <= 0) {
+                    spdlog::error("Bad size for --present: {}", value);
+                    return false;
+                }
+            } else if (std::strcmp(arg, "--window") == 0) {
+                options.window = value;
+            } else {
+                spdlog::error("Unknown option {}", arg);
+                return false;
+            }
+
+            i += 1;
+        }
+
+        return true;
+    }
+
+    // Sweeps the cursor around the screen so missiles keep turning and hitting.
+    void scriptCursor(int frame, int &x, int &y) {
+        const float t = float(frame) / 60.0f;
+        x = screen_width / 2 + int(std::cos(t * 0.7f) * screen_width * 0.35f);
+        y = screen_height / 2 + int(std::sin(t * 1.3f) * screen_height * 0.35f);
+    }
+
+#ifdef TIGR_HEADLESS
+    void scriptInput(Tigr *, TigrInput *input, void *) {
+        scriptCursor(input->frame, input->mouseX, input->mouseY);
+    }
+
+    // Creates the null window and points it at the sink named by --window.
+    Tigr *openWindow(const std::string &sink, int width, int height) {
+        Tigr *window = tigrWindow(width, height, "tigr-test", 0);
+        if (!window) {
+            return nullptr;
+        }
+
+        bool ok = false;
+        if (sink.compare(0, 4, "ring") == 0) {
+            const int frames = sink.size() > 5 && sink[4] == ':' ? std::atoi(sink.c_str() + 5) : 2;
+            tigrHeadlessRing(window, frames);
+            ok = frames > 0;
+        } else if (sink.compare(0, 4, "shm:") == 0) {
+            ok = tigrHeadlessShm(window, sink.c_str() + 4) != 0;
+        } else if (sink.compare(0, 5, "file:") == 0) {
+            ok = tigrHeadlessFile(window, sink.c_str() + 5) != 0;
+        }
+
+        if (!ok) {
+            spdlog::error("Can't open window sink {}", sink);
+            tigrFree(window);
+            return nullptr;
+        }
+
+        tigrHeadlessInput(window, scriptInput, nullptr);
+        return window;
+    }
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    options_t options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    seedRandom(options.seed);
+
+    soft_renderer_t renderer;
+    if (!initSoftRenderer(renderer, screen_width, screen_height, options.threads)) {
+        spdlog::error("Failed to allocate frame buffers");
+        return 1;
+    }
+
+    Tigr *presented = nullptr;
+    if (options.present_width > 0) {
+        presented = tigrBitmap(options.present_width, options.present_height);
+        if (!presented) {
+            spdlog::error("Failed to allocate the present buffer");
+            freeSoftRenderer(renderer);
+            return 1;
+        }
+    }
+    Tigr *output = presented ? presented : renderer.screen;
+
+    Tigr *window = nullptr;
+    if (!options.window.empty()) {
+#if defined(TIGR_HEADLESS)
+        window = openWindow(options.window, output->w, output->h);
+#elif defined(TIGR_X11)
+        if (options.window == "x11") {
+            window = tigrWindow(output->w, output->h, "tigr-test", 0);
+        } else {
+            spdlog::error("--window only takes x11 with the X11 backend");
+        }
+#else
+        spdlog::error("--window needs tigr built with TIGR_HEADLESS or TIGR_X11");
+#endif
+        if (!window) {
+            if (presented) {
+                tigrFree(presented);
+            }
+            freeSoftRenderer(renderer);
+            return 1;
+        }
+    }
+
+    frame_capture_t capture;
+    const bool save_frames = !options.png_prefix.empty();
+    const bool async_capture = save_frames && options.encoders > 0;
+    if (async_capture && !startCapture(capture, options.png_prefix, output->w, output->h,
+                                       options.encoders, options.capture_slots, options.drop_frames,
+                                       options.png_level)) {
+        spdlog::error("Failed to allocate capture buffers");
+        if (window) {
+            tigrFree(window);
+        }
+        if (presented) {
+            tigrFree(presented);
+        }
+        freeSoftRenderer(renderer);
+        return 1;
+    }
+
+    world_t world;
+    world.width = screen_width;
+    world.height = screen_height;
+
+    const float frame_dt = 1.0f / 60.0f;
+    const float dt = 0.01f;
+    float accumulator = 0.0f;
+
+    double render_seconds = 0.0;
+    TigrSaveOptions save_options {options.png_level};
+
+    double present_seconds = 0.0;
+    double window_seconds = 0.0;
+    double capture_seconds = 0.0;
+    long long entities = 0;
+    long long restored_cells = 0;
+
+    for (int frame = 0; frame < options.frames; frame += 1) {
+        soft_frame_t info;
+        if (window) {
+            tigrMouse(window, &info.mouse_x, &info.mouse_y, nullptr);
+        } else {
+            scriptCursor(frame, info.mouse_x, info.mouse_y);
+        }
+        info.frame_time = int(frame_dt * 1000);
+        info.fps = int(1.0f / frame_dt);
+
+        world.target_x = info.mouse_x;
+        world.target_y = info.mouse_y;
+
+        // Top the scene up in bursts, like holding the right mouse button.
+        for (int i = 0; i < 32 && int(world.missiles.size()) < options.missiles; i += 1) {
+            fireMissile(world);
+        }
+
+        accumulator += frame_dt;
+        while (accumulator >= dt) {
+            updateWorld(world, dt);
+            accumulator -= dt;
+        }
+        world.hits = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+        renderSoftware(renderer, world, info);
+        const auto end = std::chrono::steady_clock::now();
+        render_seconds += std::chrono::duration<double>(end - start).count();
+
+        if (presented) {
+            presentSoftware(renderer, presented);
+        }
+        const auto presented_at = std::chrono::steady_clock::now();
+        present_seconds += std::chrono::duration<double>(presented_at - end).count();
+
+        if (window) {
+            tigrBlit(window, output, 0, 0, 0, 0, output->w, output->h);
+            tigrUpdate(window);
+        }
+        const auto shown = std::chrono::steady_clock::now();
+        window_seconds += std::chrono::duration<double>(shown - presented_at).count();
+
+        restored_cells += renderer.restored_cells;
+        entities += world.missiles.size() + world.missile_particles.size() + world.explosion_particles.size();
+
+        if (async_capture) {
+            captureFrame(capture, output, frame);
+        } else if (save_frames) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s%05d.png", options.png_prefix.c_str(), frame);
+            const bool saved = renderer.tiled ? saveImageOnWorkers(renderer.tiles.pool, path, output, save_options)
+                                              : tigrSaveImageEx(path, output, &save_options) != 0;
+            if (!saved) {
+                spdlog::error("Failed to write {}", path);
+            }
+        }
+
+        capture_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - shown).count();
+    }
+
+    if (options.frames > 0) {
+        const double ms_per_frame = render_seconds * 1000.0 / options.frames;
+        const double ns_per_entity = entities > 0 ? render_seconds * 1e9 / double(entities) : 0.0;
+
+        spdlog::info("{} frames, {:.3f} ms/frame, {:.1f} entities/frame, {:.1f} ns/entity",
+                     options.frames, ms_per_frame, double(entities) / options.frames, ns_per_entity);
+        spdlog::info("{:.1f} dirty cells restored/frame", double(restored_cells) / options.frames);
+
+        if (presented) {
+            spdlog::info("present: {}x{}, {:.3f} ms/frame", presented->w, presented->h,
+                         present_seconds * 1000.0 / options.frames);
+        }
+
+        if (window) {
+            spdlog::info("window: {}, {:.3f} ms/frame", options.window, window_seconds * 1000.0 / options.frames);
+        }
+
+        if (save_frames) {
+            spdlog::info("capture: {:.3f} ms/frame on the main loop", capture_seconds * 1000.0 / options.frames);
+        }
+    }
+
+    if (async_capture) {
+        stopCapture(capture);
+        spdlog::info("capture: {} frames, {} written, {} failed, {} dropped, {} delayed ({:.1f} ms waiting)",
+                     capture.captured, capture.written, capture.failed, capture.dropped, capture.delayed,
+                     capture.delay_seconds * 1000.0);
+    }
+
+    if (window) {
+        tigrFree(window);
+    }
+    if (presented) {
+        tigrFree(presented);
+    }
+    freeSoftRenderer(renderer);
+    return 0;
+}
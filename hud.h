@@ -0,0 +1,14 @@
+#ifndef __HUD_H__
+#define __HUD_H__
+
+
+// HUD text shared by the raylib and software renderers so both show the same
+// values in the same layout.
+constexpr const char *hud_fps_format = "% 4d ms/frame\n% 4d frames/sec";
+constexpr const char *hud_particle_info_format = "% 4d missiles\n% 4d smoke\n% 4d sparks\n% 4d drawn\n% 4d culled\n% 4d draw calls";
+constexpr const char *hud_mouse_info_format = "mouse position: (% 3d, %3d)\nmouse angle: % 3d deg\nbutton: % 3d";
+
+constexpr int hud_margin = 8;
+
+
+#endif//__HUD_H__
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <algorithm>
+#include <rlgl.h>
+
+#include "label.h"
+
+
+namespace {
+    // Matches DrawText: the default font, scaled to the requested size, with
+    // one pixel of spacing per 10px of font size.
+    const int default_font_size = 10;
+
+    void layoutLabel(text_label_t &label) {
+        const Font font = GetFontDefault();
+        const int font_size = std::max(label.font_size, default_font_size);
+        const float spacing = float(font_size / default_font_size);
+        const float scale = float(font_size) / float(font.baseSize);
+        const float padding = float(font.glyphPadding);
+        const float line_height = float(int((font.baseSize + font.baseSize / 2) * scale));
+
+        float offset_x = 0.0f;
+        float offset_y = 0.0f;
+
+        // MeasureText keeps the widest line in unscaled units and the longest
+        // line in characters separately, then adds spacing per character.
+        float line_width = 0.0f;
+        float max_line_width = 0.0f;
+        int line_chars = 0;
+        int max_line_chars = 0;
+
+        label.glyphs.clear();
+        for (const char *c = label.text; *c; c += 1) {
+            const int codepoint = (unsigned char)*c;
+
+            if (codepoint == '\n') {
+                max_line_width = std::max(max_line_width, line_width);
+                line_width = 0.0f;
+                line_chars = 0;
+                offset_x = 0.0f;
+                offset_y += line_height;
+                continue;
+            }
+
+            const int index = GetGlyphIndex(font, codepoint);
+            const Rectangle &rec = font.recs[index];
+            const GlyphInfo &glyph = font.glyphs[index];
+
+            if (codepoint != ' ' && codepoint != '\t') {
+                glyph_quad_t quad;
+                quad.source = {rec.x - padding, rec.y - padding, rec.width + 2.0f * padding, rec.height + 2.0f * padding};
+                quad.dest = {offset_x + (float(glyph.offsetX) - padding) * scale,
+                             offset_y + (float(glyph.offsetY) - padding) * scale,
+                             quad.source.width * scale,
+                             quad.source.height * scale};
+                label.glyphs.push_back(quad);
+            }
+
+            const float advance = glyph.advanceX == 0 ? rec.width : float(glyph.advanceX);
+            offset_x += advance * scale + spacing;
+
+            line_width += glyph.advanceX == 0 ? rec.width + float(glyph.offsetX) : float(glyph.advanceX);
+            line_chars += 1;
+            max_line_chars = std::max(max_line_chars, line_chars);
+        }
+
+        max_line_width = std::max(max_line_width, line_width);
+
+        label.width = int(max_line_width * scale + float(max_line_chars - 1) * spacing);
+        label.height = int(offset_y + float(font_size));
+    }
+}
+
+bool updateLabel(text_label_t &label, int font_size, const char *format, std::initializer_list<int> values) {
+    const int count = std::min(int(values.size()), text_label_t::max_values);
+
+    if (label.value_count == count && label.font_size == font_size &&
+        std::equal(values.begin(), values.begin() + count, label.values)) {
+        return false;
+    }
+
+    std::copy(values.begin(), values.begin() + count, label.values);
+    label.value_count = count;
+    label.font_size = font_size;
+
+    const int *v = label.values;
+    snprintf(label.text, sizeof(label.text), format, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+
+    layoutLabel(label);
+    return true;
+}
+
+void submitLabels(const label_batch_t &batch) {
+    if (batch.draws.empty()) {
+        return;
+    }
+
+    const Font font = GetFontDefault();
+    const float tex_w = float(font.texture.width);
+    const float tex_h = float(font.texture.height);
+
+    rlSetTexture(font.texture.id);
+
+    for (const label_draw_t &draw : batch.draws) {
+        const text_label_t &label = *draw.label;
+        const float x = float(draw.x);
+        const float y = float(draw.y);
+
+        rlCheckRenderBatchLimit(int(label.glyphs.size()) * 4);
+
+        rlBegin(RL_QUADS);
+        rlColor4ub(draw.color.r, draw.color.g, draw.color.b, draw.color.a);
+        rlNormal3f(0.0f, 0.0f, 1.0f);
+
+        for (const glyph_quad_t &g : label.glyphs) {
+            const float u1 = g.source.x / tex_w;
+            const float v1 = g.source.y / tex_h;
+            const float u2 = (g.source.x + g.source.width) / tex_w;
+            const float v2 = (g.source.y + g.source.height) / tex_h;
+
+            const float x1 = x + g.dest.x;
+            const float y1 = y + g.dest.y;
+            const float x2 = x1 + g.dest.width;
+            const float y2 = y1 + g.dest.height;
+
+            rlTexCoord2f(u1, v1);
+            rlVertex2f(x1, y1);
+            rlTexCoord2f(u1, v2);
+            rlVertex2f(x1, y2);
+            rlTexCoord2f(u2, v2);
+            rlVertex2f(x2, y2);
+            rlTexCoord2f(u2, v1);
+            rlVertex2f(x2, y1);
+        }
+
+        rlEnd();
+    }
+
+    rlSetTexture(0);
+}
@@ -0,0 +1,57 @@
+#ifndef __LABEL_H__
+#define __LABEL_H__
+
+#include <initializer_list>
+#include <vector>
+#include <raylib.h>
+
+
+struct glyph_quad_t {
+    Rectangle source {};
+    Rectangle dest {};
+};
+
+// Text laid out into glyph quads relative to its top-left corner. The quads
+// are only rebuilt when one of the values the text was formatted from changes.
+struct text_label_t {
+    static const int max_values = 8;
+
+    int values[max_values] {};
+    int value_count {-1};
+    int font_size {0};
+
+    char text[256] {};
+    int width {0};
+    int height {0};
+    std::vector<glyph_quad_t> glyphs;
+};
+
+// Re-formats and re-lays out the label if the font size or any value differ
+// from the ones it was last built with. Returns true if the label changed.
+bool updateLabel(text_label_t &label, int font_size, const char *format, std::initializer_list<int> values);
+
+struct label_draw_t {
+    const text_label_t *label {nullptr};
+    int x {0};
+    int y {0};
+    Color color {};
+};
+
+// Collects the labels to draw this frame so all their glyphs go out in one
+// textured quad pass.
+struct label_batch_t {
+    std::vector<label_draw_t> draws;
+
+    inline void clear() {
+        draws.clear();
+    }
+
+    inline void add(const text_label_t &label, int x, int y, const Color &color) {
+        draws.push_back({&label, x, y, color});
+    }
+};
+
+void submitLabels(const label_batch_t &batch);
+
+
+#endif//__LABEL_H__
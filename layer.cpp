@@ -0,0 +1,47 @@
+#include "layer.h"
+
+
+bool updateLayer(layer_t &layer, int width, int height, int key, const std::function<void()> &draw) {
+    if (layer.valid && layer.width == width && layer.height == height && layer.key == key) {
+        return false;
+    }
+
+    if (layer.valid && (layer.width != width || layer.height != height)) {
+        unloadLayer(layer);
+    }
+
+    if (!layer.valid) {
+        layer.texture = LoadRenderTexture(width, height);
+    }
+
+    layer.width = width;
+    layer.height = height;
+    layer.key = key;
+    layer.valid = true;
+
+    BeginTextureMode(layer.texture);
+    draw();
+    EndTextureMode();
+
+    return true;
+}
+
+void drawLayer(const layer_t &layer, int x, int y) {
+    if (!layer.valid) {
+        return;
+    }
+
+    // Render textures are stored bottom-up, so flip the source rect.
+    const Rectangle source {0.0f, 0.0f, float(layer.width), -float(layer.height)};
+    DrawTextureRec(layer.texture.texture, source, Vector2 {float(x), float(y)}, WHITE);
+}
+
+void unloadLayer(layer_t &layer) {
+    if (!layer.valid) {
+        return;
+    }
+
+    UnloadRenderTexture(layer.texture);
+    layer.texture = RenderTexture2D {};
+    layer.valid = false;
+}
@@ -0,0 +1,27 @@
+#ifndef __LAYER_H__
+#define __LAYER_H__
+
+#include <functional>
+#include <raylib.h>
+
+
+// A render texture holding content that only changes when its size or the
+// parameters it was drawn with change. Redrawn on demand, blitted otherwise.
+struct layer_t {
+    RenderTexture2D texture {};
+    int width {0};
+    int height {0};
+    int key {0};
+    bool valid {false};
+};
+
+// Redraws the layer if the size or key differ from the cached ones.
+// Must be called outside of any BeginTextureMode/EndTextureMode pair.
+// Returns true if the layer was redrawn.
+bool updateLayer(layer_t &layer, int width, int height, int key, const std::function<void()> &draw);
+
+void drawLayer(const layer_t &layer, int x, int y);
+void unloadLayer(layer_t &layer);
+
+
+#endif//__LAYER_H__
@@ -1,17 +1,26 @@
 #include <iostream>
 #include <vector>
 #include <raylib.h>
+#include <rlgl.h>
 #include <spdlog/spdlog.h>
 
 #include "vec2.h"
 #include "missiles.h"
 #include "random.h"
+#include "batch.h"
+#include "geometry.h"
+#include "layer.h"
+#include "label.h"
+#include "spatial.h"
+#include "world.h"
+#include "hud.h"
 
 
 namespace {
     const int font_size = 10;
     const int screen_width {800};
     const int screen_height {600};
+    int grid_size {60};
     const char *window_title = "Homing missiles!!11";
 
     RenderTexture2D screen;
@@ -26,15 +35,28 @@ namespace {
     int mouse_y {0};
     int mouse_buttons {0};
 
-    int screen_x {0};
-    int screen_y {0};
+    world_t world;
 
-    float screen_shake_time {0.0f};
-    float screen_shake_life {0.0f};
+    layer_t grid_layer;
+    batch_t grid_batch;
+    batch_t scene_batch;
+    batch_t overlay_batch;
+    int draw_calls {0};
+    cull_stats_t culling;
 
-    std::vector<missile_t> missiles;
-    std::vector<missile_particle_t> missile_particles;
-    std::vector<explosion_particle_t> explosion_particles;
+    text_label_t fps_label;
+    text_label_t particle_info_label;
+    text_label_t mouse_info_label;
+    label_batch_t hud_batch;
+
+    // Only the missiles nearest the cursor get their own debug label, the
+    // rest are summarized per cell.
+    const int debug_label_count = 8;
+    const int debug_cell_size = 100;
+    spatial_grid_t debug_grid;
+    std::vector<text_label_t> debug_cell_labels;
+    text_label_t debug_missile_labels[debug_label_count];
+    label_batch_t debug_batch;
 }
 
 void init() {
@@ -50,202 +72,12 @@ void init() {
 
 void shutdown() {
     UnloadSound(explode_sound);
+    unloadLayer(grid_layer);
     UnloadRenderTexture(screen);
     CloseAudioDevice();
     CloseWindow();
 }
 
-void fireMissile() {
-    const float life = 5.0f;
-    const float velocity = 150.0f;
-
-    const int center_x = screen_width / 2;
-    const int center_y = screen_height / 2;
-
-    const float rand_x = (float)randomInt(-center_x, center_x);
-    const float rand_y = (float)randomInt(-center_y, center_y);
-    const float rand_v = (float)randomInt(0, 20);
-    const float rand_l = float((randomInt(0, 100) / 100.0f) * 5.0f);
-
-    missile_t m;
-    m.position.set({float(center_x), float(center_y)});
-    m.life = life + rand_l;
-
-    m.velocity.set({rand_x, rand_y});
-    m.velocity.setDistance(velocity + rand_v);
-
-    missiles.push_back(m);
-}
-
-void explode(const vec2_t &pos, float dt) {
-    const int n = 16;
-    const float a = float(M_PI / n * 2);
-    const float a_offset = degToRad(float(randomInt(0, 360.0f / n)));
-    const float pow = 80.0f;
-
-    float r = 0.0f;
-    for (int i = 0; i < n; i += 1) {
-        const float p_offset = float(randomInt(0, 50));
-        const float r_life = 0.9f + ((randomInt(0, 100) / 100.0f) * 0.5f);
-
-        explosion_particle_t p;
-        p.position.set(pos);
-        p.velocity.fromAngle(r + a_offset);
-        p.velocity.setDistance(pow + p_offset);
-        p.life = r_life;
-
-        explosion_particles.push_back(p);
-        r += a;
-    }
-}
-
-void shakeScreen(float dt) {
-    screen_shake_life = 0.5f;
-    screen_shake_time = 0.0f;
-}
-
-bool updateMissile(missile_t &m, float dt) {
-    static const vec2_t drag {0.97f, 0.97f};
-    static const vec2_t gravity {0.0f, -480.0f};
-    static const float turn_radius = 200.0f;
-    static const float dead_time = 2.0f;
-
-    const int target_x = mouse_x;
-    const int target_y = mouse_y;
-
-    m.life -= dt;
-
-    if (m.life < -dead_time) {
-        explode(m.position, dt);
-        return false;
-    }
-
-    if (m.life <= 0.0f) {
-        m.velocity.multiply(drag);
-        m.velocity.subtract({gravity.x * dt, gravity.y * dt});
-        m.position.add({m.velocity.x * dt, m.velocity.y * dt});
-
-
-        return true;
-    }
-
-    m.target.set({float(target_x), float(target_y)});
-    m.position.add({m.velocity.x * dt, m.velocity.y * dt});
-
-    vec2_t diff;
-    diff.set(m.target);
-    diff.subtract(m.position);
-
-    if (diff.distanceSquared() <= 5.0f) {
-        PlaySound(explode_sound);
-        explode(m.position, dt);
-        shakeScreen(dt);
-        return false;
-    }
-
-    int r = randomInt(0, 4);
-    if (r == 0) {
-        const float r_time = 0.4f + ((randomInt(0, 100) / 100.0f) * 1.2f);
-
-        missile_particle_t p;
-        p.life = r_time;
-        p.position.set(m.position);
-
-        float particle_angle = radToDeg(m.velocity.angle());
-        particle_angle += float(randomInt(-3, 3));
-
-        p.velocity.fromAngle(degToRad(-particle_angle));
-        p.velocity.setDistance(32.0f * dt);
-
-        missile_particles.push_back(p);
-    }
-
-    const float target_angle = radToDeg(diff.angle());
-    float current_angle = radToDeg(m.velocity.angle());
-    float diff_angle = target_angle - current_angle;
-    while (diff_angle < 0) {
-        diff_angle += 360.0f;
-    }
-
-    if (diff_angle < 180.0f) {
-        current_angle += std::min(turn_radius * dt, diff_angle);
-    } else if (diff_angle > 180.0f) {
-        current_angle -= std::min(turn_radius * dt, 360.0f - diff_angle);
-    }
-
-    vec2_t new_vel;
-    new_vel.fromAngle(degToRad(current_angle));
-    new_vel.setDistance(m.velocity.distance());
-
-    m.velocity.set(new_vel);
-
-    return true;
-}
-
-void updateMissiles(float dt) {
-    auto it = std::remove_if(begin(missiles), end(missiles), [dt] (missile_t &m) {
-        return !updateMissile(m, dt);
-    });
-
-    missiles.erase(it, end(missiles));
-
-    std::sort(begin(missiles), end(missiles), [] (const missile_t &m1, const missile_t &m2) {
-        return m1.position.x < m2.position.x;
-    });
-}
-
-bool updateMissileParticle(missile_particle_t &p, float dt) {
-    static const vec2_t force {0.0f, -200.0f};
-    static const vec2_t drag {0.98f, 0.98f};
-
-    p.time += dt;
-
-    if (p.time >= p.life) {
-        return false;
-    }
-
-    p.velocity.multiply(drag);
-    p.velocity.add({force.x * dt, force.y * dt});
-    p.position.add({p.velocity.x * dt, p.velocity.y * dt});
-
-    return true;
-}
-
-void updateMissileParticles(float dt) {
-    auto it = std::remove_if(begin(missile_particles), end(missile_particles),
-        [dt] (missile_particle_t &p) {
-            return !updateMissileParticle(p, dt);
-        });
-
-    missile_particles.erase(it, end(missile_particles));
-}
-
-bool updateExplosionParticle(explosion_particle_t &p, float dt) {
-    static const vec2_t force {0.0f, 100.0f};
-    static const vec2_t drag {0.99f, 0.99f};
-
-    p.time += dt;
-
-    if (p.time >= p.life) {
-        return false;
-    }
-
-    p.velocity.multiply(drag);
-    p.velocity.add({force.x * dt, force.y * dt});
-    p.position.add({p.velocity.x * dt, p.velocity.y * dt});
-
-    return true;
-}
-
-void updateExplosionParticles(float dt) {
-    auto it = std::remove_if(begin(explosion_particles), end(explosion_particles),
-        [dt] (explosion_particle_t &p) {
-            return !updateExplosionParticle(p, dt);
-        });
-
-    explosion_particles.erase(it, end(explosion_particles));
-}
-
 bool processEvents() {
     if (IsKeyDown(KEY_D)) {
         debug = !debug;
@@ -266,200 +98,142 @@ void updateMouse(float dt) {
     mouse_x = mouse_pos.x;
     mouse_y = mouse_pos.y;
 
+    world.target_x = mouse_x;
+    world.target_y = mouse_y;
+
     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-        fireMissile();
+        fireMissile(world);
     }
 
     if (IsMouseButtonDown(MOUSE_RIGHT_BUTTON)) {
         const int count = 32;
 
         for (int i = 0; i < count; i += 1) {
-            fireMissile();
+            fireMissile(world);
         }
     }
 }
 
-void updateScreenShake(float dt) {
-    static const float shake_amount = 5.0f;
-    static const float shake_speed = 48.0f;
-
-    if (screen_shake_time > screen_shake_life) {
-        screen_x = 0;
-        screen_y = 0;
-        return;
-    }
-
-    screen_shake_time += dt;
-    screen_y = int(std::sin(screen_shake_time * shake_speed) * shake_amount);
-    screen_x = int(std::cos(screen_shake_life * shake_speed * 2) * shake_amount / 4.0f);
-}
-
 void update(float dt) {
     updateMouse(dt);
-    updateScreenShake(dt);
+    updateWorld(world, dt);
 
-    updateMissiles(dt);
-    updateMissileParticles(dt);
-    updateExplosionParticles(dt);
+    if (world.hits > 0) {
+        PlaySound(explode_sound);
+        world.hits = 0;
+    }
 }
 
-void drawMissile(const missile_t &m) {
-    static const auto live_color =  Color { 255, 255, 0, 255 };
-    static const auto dead_color = Color { 37, 221, 245, 255 };
-    static const auto line_color = Color { 192, 192, 192, 255 };
+void drawMissileDebug(const missile_t &m, text_label_t &label) {
     static const auto text_color = Color { 255, 255, 255, 255 };
-
-    static const int w = 4;
-    static const int h = 4;
     static const int margin = 2;
     const int x = int(m.position.x);
     const int y = int(m.position.y);
 
-    vec2_t v;
-    v.set(m.velocity);
-    v.multiply({-1.0f, -1.0f});
-    v.setDistance(16.0f);
-
-    const Color color = m.life < 0.0f ? dead_color : live_color;
-
-    DrawRectangle(x - (w / 2), y - (h / 2), w, h, color);
-    DrawLine(x, y, x + int(v.x), y + int(v.y), line_color);
-
-    if (!debug) {
-        return;
-    }
-
     vec2_t t;
     t.set(m.target);
     t.subtract(m.position);
     t.subtract(m.velocity);
 
-    char text[256];
-    snprintf(text, sizeof(text), "p:(% 3d, % 3d)\nv:(% 3d, %3d)\na:% 4.2f\nta:% 4.2f",
-             x, y,
-             int(m.velocity.x), int(m.velocity.y),
-             radToDeg(m.velocity.angle()),
-             radToDeg(t.angle()));
-
-    DrawText(text, x + margin, y + margin, font_size, text_color);
-}
+    updateLabel(label, font_size, "p:(% 3d, % 3d)\nv:(% 3d, %3d)\na:% 4d\nta:% 4d",
+                {x, y,
+                 int(m.velocity.x), int(m.velocity.y),
+                 int(radToDeg(m.velocity.angle())),
+                 int(radToDeg(t.angle()))});
 
-void drawMissiles() {
-    for (auto &m : missiles) {
-        drawMissile(m);
-    }
+    debug_batch.add(label, x + margin, y + margin, text_color);
 }
 
-void drawMissileParticle(const missile_particle_t &p) {
-    const auto color = Color { 178, 178, 178, 255 };
+void drawCellDebug(int column, int row, const int *labelled, int labelled_count, text_label_t &label) {
+    static const auto text_color = Color { 255, 255, 255, 160 };
+    static const int margin = 2;
 
-    const int min = 2;
-    const int max = 8;
-    const int w = min + int((p.time / p.life) * (max - min));
-    const int h = w;
-    const int x = int(p.position.x);
-    const int y = int(p.position.y);
+    const int cell = debug_grid.cellIndex(column, row);
 
-    DrawRectangle(x - (w / 2), y - (h / 2), w, h, color);
-}
+    int count = 0;
+    float speed = 0.0f;
+    float life = 0.0f;
+    for (int k = debug_grid.cell_start[cell]; k < debug_grid.cell_start[cell + 1]; k += 1) {
+        const int index = debug_grid.items[k];
+        if (std::find(labelled, labelled + labelled_count, index) != labelled + labelled_count) {
+            continue;
+        }
 
-void drawMissleParticles() {
-    for (auto &p : missile_particles) {
-        drawMissileParticle(p);
+        count += 1;
+        speed += world.missiles[index].velocity.distance();
+        life += world.missiles[index].life;
     }
-}
-
-void drawExplosionParticle(const explosion_particle_t &p) {
-    const auto color = Color { 255, 255, 255, 255 };
-    const float length = clamp(p.velocity.distance() / 200.0f, 0.0f, 1.0f);
 
-    vec2_t d;
-    d.set(p.velocity);
-    d.multiply({-1.0f, -1.0f});
-    d.setDistance(length * 12.0f);
-
-    vec2_t v;
-    v.set(p.position);
-    v.add(d);
-
-    const int x1 = int(p.position.x);
-    const int y1 = int(p.position.y);
-    const int x2 = int(v.x);
-    const int y2 = int(v.y);
-
-    DrawLine(x1, y1, x2, y2, color);
-
-    const int w = 2;
-    const int h = w;
-    const int x = x1 - (w / 2);
-    const int y = y1 - (h / 2);
+    if (count == 0) {
+        return;
+    }
 
-    DrawRectangle(x + screen_width, y + screen_height, w, h, Color { 190, 120, 0, 255 });
+    updateLabel(label, font_size, "n:% 4d\nspeed:% 4d\nlife:% 5d ms",
+                {count, int(speed / float(count)), int(life / float(count) * 1000.0f)});
 
+    const int x = column * debug_grid.cell_size + margin;
+    const int y = row * debug_grid.cell_size + margin;
+    debug_batch.add(label, x, y, text_color);
 }
 
-void drawExplosionParticles() {
-    for (auto &p : explosion_particles) {
-        drawExplosionParticle(p);
+void drawMissilesDebug() {
+    if (!debug) {
+        return;
     }
-}
-
-void drawCrosshair() {
-    static const auto color = Color { 123, 175, 201, 255 };
 
-    const int x = mouse_x;
-    const int y = mouse_y;
+    buildSpatialGrid(debug_grid, world.missiles, screen_width, screen_height, debug_cell_size);
 
-    DrawLine(x, 0, x, screen_height, color);
-    DrawLine(0, y, screen_width, y, color);
-}
+    if (int(debug_cell_labels.size()) != debug_grid.cellCount()) {
+        debug_cell_labels.resize(debug_grid.cellCount());
+    }
 
-void drawArrow() {
-    const auto color = Color { 213, 246, 221, 255 };
+    int nearest[debug_label_count];
+    const int found = queryNearest(debug_grid, world.missiles, float(mouse_x), float(mouse_y), debug_label_count, nearest);
 
-    const int center_x = screen_width / 2;
-    const int center_y = screen_height / 2;
+    debug_batch.clear();
 
-    const int target_x = mouse_x;
-    const int target_y = mouse_y;
+    for (int row = 0; row < debug_grid.rows; row += 1) {
+        for (int column = 0; column < debug_grid.columns; column += 1) {
+            const int cell = debug_grid.cellIndex(column, row);
+            drawCellDebug(column, row, nearest, found, debug_cell_labels[cell]);
+        }
+    }
 
-    vec2_t v {float(target_x - center_x), float(target_y - center_y)};
-    v.setDistance(24.0f);
+    for (int i = 0; i < found; i += 1) {
+        drawMissileDebug(world.missiles[nearest[i]], debug_missile_labels[i]);
+    }
 
-    DrawLine(center_x, center_y, center_x + static_cast<int>(v.x), center_y + static_cast<int>(v.y), color);
+    submitLabels(debug_batch);
 }
 
 void drawFPS() {
     static const auto color = Color { 255, 255, 255, 255 };
-    static const int margin = 8;
+    static const int margin = hud_margin;
 
-    char text[128];
-    snprintf(text, sizeof(text), "% 4d ms/frame\n% 4d frames/sec", frame_time, fps);
+    updateLabel(fps_label, font_size, hud_fps_format, {frame_time, fps});
 
     int width = 100;
     int height = 24;
 
-    DrawText(text, screen_width - width - margin, screen_height - height - margin, font_size, color);
+    hud_batch.add(fps_label, screen_width - width - margin, screen_height - height - margin, color);
 }
 
 void drawParticleInfo() {
     static const auto color = Color { 255, 255, 255, 255 };
-    static const int margin = 8;
-    const int m_count = (int)missiles.size();
-    const int s_count = (int)missile_particles.size();
-    const int p_count = (int)explosion_particles.size();
+    static const int margin = hud_margin;
+    const int m_count = (int)world.missiles.size();
+    const int s_count = (int)world.missile_particles.size();
+    const int p_count = (int)world.explosion_particles.size();
 
-    char text[128];
-    snprintf(text, sizeof(text),
-             "% 4d missiles\n% 4d smoke\n% 4d sparks",
-             m_count, s_count, p_count);
+    updateLabel(particle_info_label, font_size, hud_particle_info_format,
+                {m_count, s_count, p_count, culling.drawn, culling.culled, draw_calls});
 
-    DrawText(text, margin, screen_height - 40 - margin, font_size, color);
+    hud_batch.add(particle_info_label, margin, screen_height - particle_info_label.height - margin, color);
 }
 
 void drawMouseInfo() {
     const auto color = Color { 255, 255, 255, 255 };
-    const int margin = 8;
+    const int margin = hud_margin;
 
     const int mouse_window_x = mouse_x;
     const int mouse_window_y = mouse_y;
@@ -471,73 +245,120 @@ void drawMouseInfo() {
     vec2_t v {float(mouse_window_x - center_x), float(mouse_window_y - center_y)};
     const int angle = (int)radToDeg(v.angle());
 
-    char text[128];
-    snprintf(text, sizeof(text),
-             "mouse position: (% 3d, %3d)\nmouse angle: % 3d deg\nbutton: % 3d",
-             mouse_x, mouse_y, angle, mouse_buttons);
-
-    int width = MeasureText(text, font_size);
+    updateLabel(mouse_info_label, font_size, hud_mouse_info_format,
+                {mouse_x, mouse_y, angle, mouse_buttons});
 
-    DrawText(text, screen_width - width - margin, margin, font_size, color);
+    hud_batch.add(mouse_info_label, screen_width - mouse_info_label.width - margin, margin, color);
 }
 
-void drawGrid() {
-    static const auto color = Color { 148, 148, 148, 255 };
-    static const int grid_size = 60;
+int submitBatch(const batch_t &batch) {
+    // Keep each rlBegin/rlEnd block well inside rlgl's default vertex buffer so
+    // the only flushes are the ones we can see and count.
+    static const int chunk_quads = 1024;
+    static const int chunk_lines = 2048;
+
+    int calls = 0;
+
+    const int quad_count = batch.quadCount();
+    if (quad_count > 0) {
+        calls += 1;
+        rlSetTexture(rlGetTextureIdDefault());
 
-    const int half_width = screen_width / 2;
-    const int half_height = screen_height / 2;
+        for (int start = 0; start < quad_count; start += chunk_quads) {
+            const int count = std::min(chunk_quads, quad_count - start);
+            if (rlCheckRenderBatchLimit(count * 4)) {
+                calls += 1;
+            }
 
-    const int grid_x_count = 2 * ((half_width / grid_size) + 1);
-    const int grid_y_count = 2 * ((half_height / grid_size) + 1);
+            rlBegin(RL_QUADS);
+            rlNormal3f(0.0f, 0.0f, 1.0f);
+            for (int i = start * 4; i < (start + count) * 4; i += 1) {
+                const batch_vertex_t &v = batch.quads[i];
+                rlColor4ub(v.color.r, v.color.g, v.color.b, v.color.a);
+                rlVertex2f(v.x, v.y);
+            }
+            rlEnd();
+        }
 
-    const int start_x = half_width - ((grid_x_count / 2) * grid_size);
-    const int start_y = half_height - ((grid_y_count / 2) * grid_size);
+        rlSetTexture(0);
+    }
 
-    for (int j = 0; j < grid_y_count; j += 1) {
-        const int y = start_y + (j * grid_size);
+    const int line_count = batch.lineCount();
+    if (line_count > 0) {
+        calls += 1;
 
-        for (int i = 0; i < grid_x_count; i += 1) {
-            const int x = start_x + (i * grid_size);
-            const int c = (i + j) % 2;
+        for (int start = 0; start < line_count; start += chunk_lines) {
+            const int count = std::min(chunk_lines, line_count - start);
+            if (rlCheckRenderBatchLimit(count * 2)) {
+                calls += 1;
+            }
 
-            if (c == 0) {
-                DrawRectangle(x, y, grid_size, grid_size, color);
+            rlBegin(RL_LINES);
+            for (int i = start * 2; i < (start + count) * 2; i += 1) {
+                const batch_vertex_t &v = batch.lines[i];
+                rlColor4ub(v.color.r, v.color.g, v.color.b, v.color.a);
+                rlVertex2f(v.x, v.y);
             }
+            rlEnd();
         }
     }
+
+    return calls;
+}
+
+Color toColor(const rgba_t &c) {
+    return Color { c.r, c.g, c.b, c.a };
+}
+
+void drawBackground() {
+    ClearBackground(toColor(background_color));
+
+    grid_batch.clear();
+    buildGridGeometry(screen_width, screen_height, grid_size, grid_batch);
+    submitBatch(grid_batch);
 }
 
 void render() {
+    updateLayer(grid_layer, screen_width, screen_height, grid_size, drawBackground);
 
     BeginTextureMode(screen);
-    ClearBackground({ 127, 127, 127, 255 });
+    drawLayer(grid_layer, 0, 0);
+
+    // Everything outside the render texture is dropped before batching.
+    const cull_rect_t view {0.0f, 0.0f, float(screen_width - 1), float(screen_height - 1)};
 
-    drawGrid();
+    scene_batch.clear();
+    culling.clear();
+    buildMissileParticleGeometry(world.missile_particles, view, scene_batch, culling);
+    buildExplosionParticleGeometry(world.explosion_particles, view, scene_batch, culling);
+    buildMissileGeometry(world.missiles, view, scene_batch, culling);
+    draw_calls = submitBatch(scene_batch);
 
-    drawMissleParticles();
-    drawExplosionParticles();
-    drawMissiles();
+    drawMissilesDebug();
 
     EndTextureMode();
     BeginDrawing();
-    ClearBackground({ 64, 64, 64, 255 });
+    ClearBackground(toColor(border_color));
 
     DrawTexturePro(
         screen.texture,
         Rectangle { 0, 0, screen_width, -screen_height },
-        Rectangle { static_cast<float>(screen_x), static_cast<float>(screen_y), screen_width, screen_height },
+        Rectangle { static_cast<float>(world.screen_x), static_cast<float>(world.screen_y), screen_width, screen_height },
         Vector2 { 0, 0 },
         0.0f,
         WHITE
     );
 
-    drawCrosshair();
-    drawArrow();
+    overlay_batch.clear();
+    buildCrosshairGeometry(screen_width, screen_height, mouse_x, mouse_y, overlay_batch);
+    buildArrowGeometry(screen_width, screen_height, mouse_x, mouse_y, overlay_batch);
+    submitBatch(overlay_batch);
 
+    hud_batch.clear();
     drawFPS();
     drawParticleInfo();
     drawMouseInfo();
+    submitLabels(hud_batch);
 
     EndDrawing();
 }
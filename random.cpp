@@ -1,7 +1,17 @@
 #include "random.h"
 
+namespace {
+    std::mt19937 &generator() {
+        static std::mt19937 gen {(std::random_device {})()};
+        return gen;
+    }
+}
+
 int randomInt(int min, int max) {
-    static std::mt19937 gen {(std::random_device {})()};
     std::uniform_int_distribution<> dis(min, max);
-    return dis(gen);
+    return dis(generator());
+}
+
+void seedRandom(unsigned seed) {
+    generator().seed(seed);
 }
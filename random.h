@@ -6,5 +6,8 @@
 
 int randomInt(int min, int max);
 
+// Reseeds the generator so runs can be reproduced.
+void seedRandom(unsigned seed);
+
 
 #endif//__RANDOM_H__
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "soft_render.h"
+#include "geometry.h"
+#include "hud.h"
+
+
+namespace {
+    inline TPixel toPixel(const rgba_t &c) {
+        return tigrRGBA(c.r, c.g, c.b, c.a);
+    }
+
+    // Every pixel a batch can write, the same bounds drawBatchSoftware draws.
+    void markBatch(dirty_grid_t &grid, const batch_t &batch) {
+        for (size_t i = 0; i < batch.quads.size(); i += 4) {
+            const batch_vertex_t &a = batch.quads[i];
+            const batch_vertex_t &b = batch.quads[i + 2];
+            markDirty(grid, int(a.x), int(a.y), int(b.x) - 1, int(b.y) - 1);
+        }
+
+        for (size_t i = 0; i < batch.lines.size(); i += 2) {
+            const batch_vertex_t &a = batch.lines[i];
+            const batch_vertex_t &b = batch.lines[i + 1];
+            markDirty(grid,
+                      std::min(int(a.x), int(b.x)), std::min(int(a.y), int(b.y)),
+                      std::max(int(a.x), int(b.x)), std::max(int(a.y), int(b.y)));
+        }
+    }
+
+    void updateBackground(soft_renderer_t &renderer, int grid_size) {
+        if (renderer.background_grid_size == grid_size) {
+            return;
+        }
+
+        renderer.batch.clear();
+        buildGridGeometry(renderer.width, renderer.height, grid_size, renderer.batch);
+
+        tigrClear(renderer.background, toPixel(background_color));
+        drawBatchSoftware(renderer.background, renderer.batch);
+
+        renderer.background_grid_size = grid_size;
+        invalidateDirtyGrid(renderer.scene_dirty);
+    }
+
+    struct hud_text_t {
+        char text[256];
+        int x;
+        int y;
+        int w;
+        int h;
+    };
+
+    // Formats and places the HUD, so its bounds are known before drawing.
+    void layoutHud(const soft_renderer_t &renderer, const world_t &world, const soft_frame_t &frame,
+                   hud_text_t (&hud)[3]) {
+        const int center_x = renderer.width / 2;
+        const int center_y = renderer.height / 2;
+        vec2_t v {float(frame.mouse_x - center_x), float(frame.mouse_y - center_y)};
+        const int angle = (int)radToDeg(v.angle());
+
+        snprintf(hud[0].text, sizeof(hud[0].text), hud_fps_format, frame.frame_time, frame.fps);
+        snprintf(hud[1].text, sizeof(hud[1].text), hud_particle_info_format,
+                 (int)world.missiles.size(), (int)world.missile_particles.size(),
+                 (int)world.explosion_particles.size(), renderer.culling.drawn, renderer.culling.culled,
+                 renderer.draw_calls);
+        snprintf(hud[2].text, sizeof(hud[2].text), hud_mouse_info_format,
+                 frame.mouse_x, frame.mouse_y, angle, frame.mouse_buttons);
+
+        for (auto &text : hud) {
+            text.w = tigrTextWidth(tfont, text.text);
+            text.h = tigrTextHeight(tfont, text.text);
+        }
+
+        hud[0].x = renderer.width - hud[0].w - hud_margin;
+        hud[0].y = renderer.height - hud[0].h - hud_margin;
+        hud[1].x = hud_margin;
+        hud[1].y = renderer.height - hud[1].h - hud_margin;
+        hud[2].x = renderer.width - hud[2].w - hud_margin;
+        hud[2].y = hud_margin;
+    }
+
+    void drawHud(soft_renderer_t &renderer, const hud_text_t (&hud)[3]) {
+        const TPixel color = tigrRGB(255, 255, 255);
+
+        for (const auto &text : hud) {
+            tigrPrint(renderer.screen, tfont, text.x, text.y, color, "%s", text.text);
+        }
+    }
+
+    // Border where the shaken scene leaves a gap, scene everywhere else.
+    void composeScreen(soft_renderer_t &renderer, int x, int y, int w, int h, int shake_x, int shake_y) {
+        tigrFill(renderer.screen, x, y, w, h, toPixel(border_color));
+
+        const int x1 = std::max(x, shake_x);
+        const int y1 = std::max(y, shake_y);
+        const int x2 = std::min(x + w, shake_x + renderer.width);
+        const int y2 = std::min(y + h, shake_y + renderer.height);
+        if (x1 < x2 && y1 < y2) {
+            tigrBlit(renderer.screen, renderer.scene, x1, y1, x1 - shake_x, y1 - shake_y, x2 - x1, y2 - y1);
+        }
+    }
+}
+
+bool initSoftRenderer(soft_renderer_t &renderer, int width, int height, int threads) {
+    renderer.width = width;
+    renderer.height = height;
+    renderer.screen = tigrBitmap(width, height);
+    renderer.scene = tigrBitmap(width, height);
+    renderer.background = tigrBitmap(width, height);
+    renderer.background_grid_size = 0;
+
+    // The HUD font is only ever blended, convert it once.
+    tigrPremultiplyFont(tfont);
+
+    initDirtyGrid(renderer.scene_dirty, width, height);
+    initDirtyGrid(renderer.screen_dirty, width, height);
+
+    renderer.tiled = threads > 0;
+    if (renderer.tiled) {
+        initTileRaster(renderer.tiles, threads);
+    }
+
+    return renderer.screen && renderer.scene && renderer.background;
+}
+
+void freeSoftRenderer(soft_renderer_t &renderer) {
+    if (renderer.tiled) {
+        freeTileRaster(renderer.tiles);
+        renderer.tiled = false;
+    }
+
+    for (Tigr *bmp : {renderer.screen, renderer.scene, renderer.background}) {
+        if (bmp) {
+            tigrFree(bmp);
+        }
+    }
+
+    renderer.screen = nullptr;
+    renderer.scene = nullptr;
+    renderer.background = nullptr;
+}
+
+int drawBatchSoftware(Tigr *bmp, const batch_t &batch) {
+    int passes = 0;
+
+    if (!batch.quads.empty()) {
+        passes += 1;
+
+        // Quads go to tigrFillRects a chunk at a time, translucent ones blend
+        // like the GPU does.
+        const size_t chunk = 256;
+        TigrRect rects[chunk];
+        size_t count = 0;
+
+        for (size_t i = 0; i < batch.quads.size(); i += 4) {
+            const batch_vertex_t &a = batch.quads[i];
+            const batch_vertex_t &b = batch.quads[i + 2];
+            rects[count] = {int(a.x), int(a.y), int(b.x - a.x), int(b.y - a.y), toPixel(a.color)};
+
+            count += 1;
+            if (count == chunk) {
+                tigrFillRects(bmp, rects, int(count));
+                count = 0;
+            }
+        }
+        tigrFillRects(bmp, rects, int(count));
+    }
+
+    if (!batch.lines.empty()) {
+        passes += 1;
+
+        for (size_t i = 0; i < batch.lines.size(); i += 2) {
+            const batch_vertex_t &a = batch.lines[i];
+            const batch_vertex_t &b = batch.lines[i + 1];
+            tigrLine(bmp, int(a.x), int(a.y), int(b.x), int(b.y), toPixel(a.color));
+        }
+    }
+
+    return passes;
+}
+
+int drawBatchTiled(tile_raster_t &tiles, const batch_t &batch) {
+    int passes = 0;
+
+    if (!batch.quads.empty()) {
+        passes += 1;
+
+        for (size_t i = 0; i < batch.quads.size(); i += 4) {
+            const batch_vertex_t &a = batch.quads[i];
+            const batch_vertex_t &b = batch.quads[i + 2];
+            tileFill(tiles, int(a.x), int(a.y), int(b.x - a.x), int(b.y - a.y), toPixel(a.color));
+        }
+    }
+
+    if (!batch.lines.empty()) {
+        passes += 1;
+
+        for (size_t i = 0; i < batch.lines.size(); i += 2) {
+            const batch_vertex_t &a = batch.lines[i];
+            const batch_vertex_t &b = batch.lines[i + 1];
+            tileLine(tiles, int(a.x), int(a.y), int(b.x), int(b.y), toPixel(a.color));
+        }
+    }
+
+    return passes;
+}
+
+void renderSoftware(soft_renderer_t &renderer, const world_t &world, const soft_frame_t &frame) {
+    updateBackground(renderer, frame.grid_size);
+
+    const cull_rect_t view {0.0f, 0.0f, float(renderer.width - 1), float(renderer.height - 1)};
+
+    renderer.batch.clear();
+    renderer.culling.clear();
+    buildMissileParticleGeometry(world.missile_particles, view, renderer.batch, renderer.culling);
+    buildExplosionParticleGeometry(world.explosion_particles, view, renderer.batch, renderer.culling);
+    buildMissileGeometry(world.missiles, view, renderer.batch, renderer.culling);
+
+    // Scene: put the background back wherever entities were or are now,
+    // then draw them. Whatever changes in the scene changes on screen too.
+    const int shake_x = world.screen_x;
+    const int shake_y = world.screen_y;
+    markBatch(renderer.scene_dirty, renderer.batch);
+
+    if (renderer.tiled) {
+        beginTiles(renderer.tiles, renderer.scene);
+    }
+
+    renderer.restored_cells = forEachDirtySpan(renderer.scene_dirty, [&renderer, shake_x, shake_y] (int x, int y, int w, int h) {
+        if (renderer.tiled) {
+            tileBlit(renderer.tiles, renderer.background, x, y, x, y, w, h);
+        } else {
+            tigrBlit(renderer.scene, renderer.background, x, y, x, y, w, h);
+        }
+        markDirty(renderer.screen_dirty, x + shake_x, y + shake_y, x + shake_x + w - 1, y + shake_y + h - 1);
+    });
+
+    if (renderer.tiled) {
+        renderer.draw_calls = drawBatchTiled(renderer.tiles, renderer.batch);
+        flushTiles(renderer.tiles);
+    } else {
+        renderer.draw_calls = drawBatchSoftware(renderer.scene, renderer.batch);
+    }
+
+    // Screen: recompose under the scene changes, the overlay and the HUD,
+    // or all of it when the shake moved the scene.
+    renderer.batch.clear();
+    buildCrosshairGeometry(renderer.width, renderer.height, frame.mouse_x, frame.mouse_y, renderer.batch);
+    buildArrowGeometry(renderer.width, renderer.height, frame.mouse_x, frame.mouse_y, renderer.batch);
+    markBatch(renderer.screen_dirty, renderer.batch);
+
+    hud_text_t hud[3];
+    layoutHud(renderer, world, frame, hud);
+    for (const auto &text : hud) {
+        markDirty(renderer.screen_dirty, text.x, text.y, text.x + text.w - 1, text.y + text.h - 1);
+    }
+
+    if (shake_x != renderer.composed_x || shake_y != renderer.composed_y) {
+        invalidateDirtyGrid(renderer.screen_dirty);
+        renderer.composed_x = shake_x;
+        renderer.composed_y = shake_y;
+    }
+
+    renderer.restored_cells += forEachDirtySpan(renderer.screen_dirty, [&renderer, shake_x, shake_y] (int x, int y, int w, int h) {
+        composeScreen(renderer, x, y, w, h, shake_x, shake_y);
+    });
+
+    drawBatchSoftware(renderer.screen, renderer.batch);
+    drawHud(renderer, hud);
+
+    nextDirtyFrame(renderer.scene_dirty);
+    nextDirtyFrame(renderer.screen_dirty);
+}
+
+void presentSoftware(soft_renderer_t &renderer, Tigr *target) {
+    int w = target->w;
+    int h = renderer.height * w / renderer.width;
+    if (h > target->h) {
+        h = target->h;
+        w = renderer.width * h / renderer.height;
+    }
+    const int x = (target->w - w) / 2;
+    const int y = (target->h - h) / 2;
+
+    const TPixel black = tigrRGB(0, 0, 0);
+    tigrFill(target, 0, 0, target->w, y, black);
+    tigrFill(target, 0, y + h, target->w, target->h - y - h, black);
+    tigrFill(target, 0, y, x, h, black);
+    tigrFill(target, x + w, y, target->w - x - w, h, black);
+
+    if (!renderer.tiled) {
+        tigrBlitScaled(target, renderer.screen, x, y, w, h);
+        return;
+    }
+
+    const int workers = renderer.tiles.pool.workerCount();
+    runOnWorkers(renderer.tiles.pool, [&renderer, target, x, y, w, h, workers] (int worker) {
+        tigrBlitScaledRows(target, renderer.screen, x, y, w, h, h * worker / workers, h * (worker + 1) / workers);
+    });
+}
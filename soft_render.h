@@ -0,0 +1,66 @@
+#ifndef __SOFT_RENDER_H__
+#define __SOFT_RENDER_H__
+
+#include "tigr.h"
+#include "batch.h"
+#include "geometry.h"
+#include "world.h"
+#include "tile_raster.h"
+#include "dirty.h"
+
+
+// Per-frame values that come from the frontend rather than the simulation.
+struct soft_frame_t {
+    int mouse_x {0};
+    int mouse_y {0};
+    int mouse_buttons {0};
+    int frame_time {0};
+    int fps {0};
+    int grid_size {60};
+};
+
+// Draws the same frame as the raylib renderer into tigr bitmaps on the CPU.
+struct soft_renderer_t {
+    int width {0};
+    int height {0};
+
+    Tigr *screen {nullptr};     // final frame: border, shaken scene, overlay, HUD
+    Tigr *scene {nullptr};      // stands in for the raylib render texture
+    Tigr *background {nullptr}; // cached clear and checkerboard
+    int background_grid_size {0};
+
+    batch_t batch;
+    int draw_calls {0};
+    cull_stats_t culling;
+
+    // With threads the scene pass goes through the tiled rasterizer.
+    bool tiled {false};
+    tile_raster_t tiles;
+
+    // Scene and screen persist between frames; only cells drawn over this
+    // frame or the last one are restored from the layer below.
+    dirty_grid_t scene_dirty;
+    dirty_grid_t screen_dirty;
+    int composed_x {0}; // scene offset the screen was last composed with
+    int composed_y {0};
+    int restored_cells {0};
+};
+
+// threads = 0 draws on the calling thread only, otherwise the scene is
+// rasterized in tiles by that many workers (the caller included).
+bool initSoftRenderer(soft_renderer_t &renderer, int width, int height, int threads = 0);
+void freeSoftRenderer(soft_renderer_t &renderer);
+
+void renderSoftware(soft_renderer_t &renderer, const world_t &world, const soft_frame_t &frame);
+
+// Scales the finished screen into target, centred and keeping its aspect
+// ratio, for presenting without a GPU. Split in bands over the tile
+// workers when there are any.
+void presentSoftware(soft_renderer_t &renderer, Tigr *target);
+
+// Rasterizes a batch with tigr primitives. Returns the number of passes drawn.
+int drawBatchSoftware(Tigr *bmp, const batch_t &batch);
+int drawBatchTiled(tile_raster_t &tiles, const batch_t &batch);
+
+
+#endif//__SOFT_RENDER_H__
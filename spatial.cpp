@@ -0,0 +1,121 @@
+#include <algorithm>
+
+#include "spatial.h"
+
+
+namespace {
+    inline int cellCoord(float v, int cell_size, int count) {
+        const int c = int(v) / cell_size;
+        return std::min(std::max(c, 0), count - 1);
+    }
+}
+
+void buildSpatialGrid(spatial_grid_t &grid, const std::vector<missile_t> &missiles,
+                      int width, int height, int cell_size) {
+    grid.cell_size = cell_size;
+    grid.columns = (width + cell_size - 1) / cell_size;
+    grid.rows = (height + cell_size - 1) / cell_size;
+
+    const int cells = grid.cellCount();
+    const int count = int(missiles.size());
+
+    grid.cell_start.assign(cells + 1, 0);
+    grid.items.resize(count);
+    grid.item_cell.resize(count);
+
+    for (int i = 0; i < count; i += 1) {
+        const int column = cellCoord(missiles[i].position.x, cell_size, grid.columns);
+        const int row = cellCoord(missiles[i].position.y, cell_size, grid.rows);
+        const int cell = grid.cellIndex(column, row);
+
+        grid.item_cell[i] = cell;
+        grid.cell_start[cell] += 1;
+    }
+
+    // Turn the counts into the end of each cell, then fill backwards so every
+    // cell's entry ends up at its start and items keep their original order.
+    for (int c = 1; c < cells; c += 1) {
+        grid.cell_start[c] += grid.cell_start[c - 1];
+    }
+
+    for (int i = count - 1; i >= 0; i -= 1) {
+        const int cell = grid.item_cell[i];
+        grid.cell_start[cell] -= 1;
+        grid.items[grid.cell_start[cell]] = i;
+    }
+
+    grid.cell_start[cells] = count;
+}
+
+int queryNearest(const spatial_grid_t &grid, const std::vector<missile_t> &missiles,
+                 float x, float y, int n, int *out) {
+    if (n <= 0 || grid.items.empty()) {
+        return 0;
+    }
+
+    const int center_column = cellCoord(x, grid.cell_size, grid.columns);
+    const int center_row = cellCoord(y, grid.cell_size, grid.rows);
+    const int max_ring = std::max(grid.columns, grid.rows);
+
+    // Closest first, kept sorted with an insertion step; n is small.
+    float best_distance[64];
+    n = std::min(n, int(sizeof(best_distance) / sizeof(best_distance[0])));
+    int found = 0;
+
+    for (int ring = 0; ring <= max_ring; ring += 1) {
+        // Every cell in this ring is at least (ring - 1) cells away from the
+        // query point, so stop once that can't beat the current worst match.
+        if (found == n) {
+            const float reach = float((ring - 1) * grid.cell_size);
+            if (reach > 0.0f && reach * reach > best_distance[found - 1]) {
+                break;
+            }
+        }
+
+        auto visit = [&] (int column, int row) {
+            const int cell = grid.cellIndex(column, row);
+            for (int k = grid.cell_start[cell]; k < grid.cell_start[cell + 1]; k += 1) {
+                const int index = grid.items[k];
+                const float dx = missiles[index].position.x - x;
+                const float dy = missiles[index].position.y - y;
+                const float d = dx * dx + dy * dy;
+
+                if (found == n && d >= best_distance[found - 1]) {
+                    continue;
+                }
+
+                int j = found < n ? found++ : found - 1;
+                while (j > 0 && best_distance[j - 1] > d) {
+                    best_distance[j] = best_distance[j - 1];
+                    out[j] = out[j - 1];
+                    j -= 1;
+                }
+                best_distance[j] = d;
+                out[j] = index;
+            }
+        };
+
+        const int left = center_column - ring;
+        const int right = center_column + ring;
+        const int column_min = std::max(left, 0);
+        const int column_max = std::min(right, grid.columns - 1);
+
+        for (int row = std::max(center_row - ring, 0); row <= std::min(center_row + ring, grid.rows - 1); row += 1) {
+            if (row == center_row - ring || row == center_row + ring) {
+                for (int column = column_min; column <= column_max; column += 1) {
+                    visit(column, row);
+                }
+                continue;
+            }
+
+            if (left >= 0) {
+                visit(left, row);
+            }
+            if (right < grid.columns) {
+                visit(right, row);
+            }
+        }
+    }
+
+    return found;
+}
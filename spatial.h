@@ -0,0 +1,38 @@
+#ifndef __SPATIAL_H__
+#define __SPATIAL_H__
+
+#include <vector>
+
+#include "missiles.h"
+
+
+// Uniform grid over the screen, rebuilt each frame with a counting sort.
+// Missiles outside the screen are binned into the nearest border cell.
+struct spatial_grid_t {
+    int cell_size {0};
+    int columns {0};
+    int rows {0};
+
+    std::vector<int> cell_start; // columns * rows + 1 offsets into items
+    std::vector<int> items;      // missile indices grouped by cell
+    std::vector<int> item_cell;  // cell of each missile, scratch for the sort
+
+    inline int cellCount() const {
+        return columns * rows;
+    }
+
+    inline int cellIndex(int column, int row) const {
+        return row * columns + column;
+    }
+};
+
+void buildSpatialGrid(spatial_grid_t &grid, const std::vector<missile_t> &missiles,
+                      int width, int height, int cell_size);
+
+// Writes the indices of up to n missiles nearest to (x, y) into out, closest
+// first, and returns how many were found.
+int queryNearest(const spatial_grid_t &grid, const std::vector<missile_t> &missiles,
+                 float x, float y, int n, int *out);
+
+
+#endif//__SPATIAL_H__
@@ -67,6 +67,45 @@ typedef struct {
 } GLStuff;
 #endif
 
+#if defined(TIGR_X11) && !defined(TIGR_HEADLESS) && !defined(_WIN32) && !defined(__APPLE__)
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+typedef struct {
+	Display *dpy;
+	Window window;
+	GC gc;
+	Atom wmDeleteWindow;
+	Visual *visual;
+	int depth;
+	int width, height;		// size of img, what the window was last presented at
+	int windowW, windowH;	// latest size from ConfigureNotify
+	XImage *img;			// the scaled frame, in shared memory when useShm is set
+	XShmSegmentInfo shm;
+	int useShm;
+	int shmCompletion;		// event type of XShmCompletionEvent
+	int shmPending;			// puts the server hasn't finished reading yet
+	Tigr frame;				// img's pixels as a bitmap to scale into
+	Tigr *presented;		// copy of the last presented bitmap, to find changed rows
+	int full;				// next present redraws the whole window
+	int mouseX, mouseY, mouseButtons;
+} X11Stuff;
+#endif
+
+#ifdef TIGR_HEADLESS
+#include <stdio.h>
+typedef struct {
+	TigrInput input;
+	TigrInputScript script;
+	void *userdata;
+	Tigr **ring;			// the last ringSize frames, by frame number
+	int ringSize;
+	TigrShmHeader *shm;		// mapped segment, the frame follows the header
+	size_t shmSize;
+	FILE *file;
+} HeadlessStuff;
+#endif
+
 typedef struct {
 	int shown, closed;
 	#ifdef TIGR_GAPI_D3D9
@@ -84,6 +123,12 @@ typedef struct {
 	#ifdef __APPLE__
 	void *glContext;
 	#endif
+	#if defined(TIGR_X11) && !defined(TIGR_HEADLESS) && !defined(_WIN32) && !defined(__APPLE__)
+	X11Stuff x11;
+	#endif
+	#ifdef TIGR_HEADLESS
+	HeadlessStuff headless;
+	#endif
 
 	Tigr *widgets;
 	int widgetsWanted;
@@ -106,6 +151,12 @@ typedef struct {
 
 TigrInternal *tigrInternal(Tigr *bmp);
 
+// Bitmap pixel storage: 64-byte aligned, rows padded to TIGR_ROW_PIXELS.
+#define TIGR_ROW_PIXELS 16
+int tigrStride(int w);
+TPixel *tigrAllocPixels(int stride, int h);
+void tigrFreePixels(TPixel *pix);
+
 void tigrGAPICreate(Tigr *bmp);
 void tigrGAPIDestroy(Tigr *bmp);
 void tigrGAPIBegin(Tigr *bmp);
@@ -139,12 +190,39 @@ void tigrGAPIPresent(Tigr *bmp, int w, int h);
 		return
 
 
+int tigrStride(int w)
+{
+	return (w + TIGR_ROW_PIXELS - 1) & ~(TIGR_ROW_PIXELS - 1);
+}
+
+// The block is over-allocated and the pointer calloc returned is kept just
+// in front of the aligned pixels, for tigrFreePixels.
+TPixel *tigrAllocPixels(int stride, int h)
+{
+	size_t bytes = (size_t)stride * h * sizeof(TPixel);
+	unsigned char *raw = (unsigned char *)calloc(1, bytes + 64 + sizeof(void *));
+	unsigned char *pix;
+	if (!raw)
+		return NULL;
+
+	pix = (unsigned char *)(((size_t)raw + sizeof(void *) + 63) & ~(size_t)63);
+	((void **)pix)[-1] = raw;
+	return (TPixel *)pix;
+}
+
+void tigrFreePixels(TPixel *pix)
+{
+	if (pix)
+		free(((void **)pix)[-1]);
+}
+
 Tigr *tigrBitmap2(int w, int h, int extra)
 {
 	Tigr *tigr = (Tigr *)calloc(1, sizeof(Tigr) + extra);
 	tigr->w = w;
 	tigr->h = h;
-	tigr->pix = (TPixel *)calloc(w*h, sizeof(TPixel));
+	tigr->stride = tigrStride(w);
+	tigr->pix = tigrAllocPixels(tigr->stride, h);
 	return tigr;
 }
 
@@ -155,19 +233,20 @@ Tigr *tigrBitmap(int w, int h)
 
 void tigrResize(Tigr *bmp, int w, int h)
 {
-	int y, cw, ch;
-	TPixel *newpix = (TPixel *)calloc(w*h, sizeof(TPixel));
+	int y, cw, ch, stride = tigrStride(w);
+	TPixel *newpix = tigrAllocPixels(stride, h);
 	cw = (w < bmp->w) ? w : bmp->w;
 	ch = (h < bmp->h) ? h : bmp->h;
 
 	// Copy any old data across.
 	for (y=0;y<ch;y++)
-		memcpy(newpix+y*w, bmp->pix+y*bmp->w, cw*sizeof(TPixel));
+		memcpy(newpix+y*stride, bmp->pix+y*bmp->stride, cw*sizeof(TPixel));
 
-	free(bmp->pix);
+	tigrFreePixels(bmp->pix);
 	bmp->pix = newpix;
 	bmp->w = w;
 	bmp->h = h;
+	bmp->stride = stride;
 }
 
 int tigrCalcScale(int bmpW, int bmpH, int areaW, int areaH)
@@ -205,18 +284,151 @@ void tigrPosition(Tigr *bmp, int scale, int windowW, int windowH, int out[4])
 	out[3] = out[1] + bmp->h*scale;
 }
 
-void tigrClear(Tigr *bmp, TPixel color)
+#if defined(__AVX2__)
+#define TIGR_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIGR_SSE2
+#include <emmintrin.h>
+#endif
+
+// Fills bigger than this won't be read back from cache anyway, so they
+// use non-temporal stores instead of evicting everything else.
+#ifndef TIGR_STREAM_BYTES
+#define TIGR_STREAM_BYTES (4 << 20)
+#endif
+
+// Reference span fill, and the fallback without a vector unit.
+static void tigrFillSpanRef(TPixel *td, int count, TPixel color)
 {
-	int count = bmp->w * bmp->h;
-	int n;
+	int i;
+	for (i=0;i<count;i++)
+		td[i] = color;
+}
+
+#if defined(TIGR_AVX2)
+// Aligns to 32 bytes, then writes a cache line per iteration.
+static void tigrFillSpan(TPixel *td, int count, TPixel color, int stream)
+{
+	unsigned c;
+	__m256i v;
+	memcpy(&c, &color, sizeof(c));
+	v = _mm256_set1_epi32((int)c);
+
+	while (count > 0 && ((size_t)td & 31)) { *td++ = color; count--; }
+
+	if (stream) {
+		for (;count>=16;count-=16,td+=16) {
+			_mm256_stream_si256((__m256i *)td, v);
+			_mm256_stream_si256((__m256i *)(td + 8), v);
+		}
+	} else {
+		for (;count>=16;count-=16,td+=16) {
+			_mm256_store_si256((__m256i *)td, v);
+			_mm256_store_si256((__m256i *)(td + 8), v);
+		}
+	}
+	if (count >= 8) { _mm256_store_si256((__m256i *)td, v); count -= 8; td += 8; }
+
+	tigrFillSpanRef(td, count, color);
+}
+#elif defined(TIGR_SSE2)
+// Aligns to 16 bytes, then writes a cache line per iteration.
+static void tigrFillSpan(TPixel *td, int count, TPixel color, int stream)
+{
+	unsigned c;
+	__m128i v;
+	memcpy(&c, &color, sizeof(c));
+	v = _mm_set1_epi32((int)c);
+
+	while (count > 0 && ((size_t)td & 15)) { *td++ = color; count--; }
+
+	if (stream) {
+		for (;count>=16;count-=16,td+=16) {
+			_mm_stream_si128((__m128i *)td, v);
+			_mm_stream_si128((__m128i *)(td + 4), v);
+			_mm_stream_si128((__m128i *)(td + 8), v);
+			_mm_stream_si128((__m128i *)(td + 12), v);
+		}
+	} else {
+		for (;count>=16;count-=16,td+=16) {
+			_mm_store_si128((__m128i *)td, v);
+			_mm_store_si128((__m128i *)(td + 4), v);
+			_mm_store_si128((__m128i *)(td + 8), v);
+			_mm_store_si128((__m128i *)(td + 12), v);
+		}
+	}
+	for (;count>=4;count-=4,td+=4)
+		_mm_store_si128((__m128i *)td, v);
+
+	tigrFillSpanRef(td, count, color);
+}
+#else
+static void tigrFillSpan(TPixel *td, int count, TPixel color, int stream)
+{
+	(void)stream;
+	tigrFillSpanRef(td, count, color);
+}
+#endif
+
+// Streaming stores are weakly ordered, fence them before anyone reads.
+static void tigrFillDone(int stream)
+{
+#if defined(TIGR_SSE2) || defined(TIGR_AVX2)
+	if (stream)
+		_mm_sfence();
+#else
+	(void)stream;
+#endif
+}
+
+// Color as stored in a premultiplied bitmap.
+static TPixel tigrPremultiplyPixel(TPixel p)
+{
+	int xa = EXPAND(p.a);
+	p.r = (unsigned char)((p.r * xa) >> 8);
+	p.g = (unsigned char)((p.g * xa) >> 8);
+	p.b = (unsigned char)((p.b * xa) >> 8);
+	return p;
+}
+
+void tigrPremultiply(Tigr *bmp)
+{
+	int n, count;
+	if (bmp->premultiplied)
+		return;
+
+	// Padding pixels are converted too, it's cheaper than skipping them.
+	count = bmp->stride * bmp->h;
 	for (n=0;n<count;n++)
-		bmp->pix[n] = color;
+		bmp->pix[n] = tigrPremultiplyPixel(bmp->pix[n]);
+	bmp->premultiplied = 1;
+}
+
+// Blend factor for drawing a color onto bmp. Non-premultiplied bitmaps have
+// always applied the color's alpha twice; premultiplied ones apply it once,
+// which makes d + (s - d)*a the same as s*a + d*(1 - a).
+static int tigrBlendFactor(Tigr *bmp, TPixel color)
+{
+	return bmp->premultiplied ? EXPAND(color.a) << 8 : EXPAND(color.a) * EXPAND(color.a);
+}
+
+// Clears the row padding too, so the whole bitmap is one span.
+void tigrClear(Tigr *bmp, TPixel color)
+{
+	int count = bmp->stride * bmp->h;
+	int stream = (size_t)count * sizeof(TPixel) > TIGR_STREAM_BYTES;
+	if (bmp->premultiplied)
+		color = tigrPremultiplyPixel(color);
+	tigrFillSpan(bmp->pix, count, color, stream);
+	tigrFillDone(stream);
 }
 
 void tigrFill(Tigr *bmp, int x, int y, int w, int h, TPixel color)
 {
 	TPixel *td;
-	int dt, i;
+	int dt, stream;
 
 	if (x < 0) { w += x; x = 0; }
 	if (y < 0) { h += y; y = 0; }
@@ -225,65 +437,283 @@ void tigrFill(Tigr *bmp, int x, int y, int w, int h, TPixel color)
 	if (w <= 0 || h <= 0)
 		return;
 
-	td = &bmp->pix[y*bmp->w + x];
-	dt = bmp->w;
+	stream = (size_t)w * h * sizeof(TPixel) > TIGR_STREAM_BYTES;
+	if (bmp->premultiplied)
+		color = tigrPremultiplyPixel(color);
+	td = &bmp->pix[y*bmp->stride + x];
+	dt = bmp->stride;
 	do {
-		for (i=0;i<w;i++)
-			td[i] = color;
+		tigrFillSpan(td, w, color, stream);
 		td += dt;
 	} while(--h);
+	tigrFillDone(stream);
+}
+
+// Same arithmetic as tigrPlot, with a from tigrBlendFactor.
+static void tigrBlendPixel(TPixel *d, TPixel pix, int a)
+{
+	d->r += (unsigned char)((pix.r - d->r)*a >> 16);
+	d->g += (unsigned char)((pix.g - d->g)*a >> 16);
+	d->b += (unsigned char)((pix.b - d->b)*a >> 16);
+	d->a += (unsigned char)((pix.a - d->a)*a >> 16);
+}
+
+// Steps n >= 0 for which p0 + s*n stays inside [0, size).
+static void tigrLineAxis(int p0, int s, int size, long long *lo, long long *hi)
+{
+	*lo = (s > 0) ? -(long long)p0 : (long long)p0 - (size - 1);
+	*hi = (s > 0) ? (long long)size - 1 - p0 : p0;
+	if (*lo < 0) *lo = 0;
 }
 
+// tigrLine below is the error-term Bresenham walk
+//
+//   e2 = 2*err; if (e2 > -dy) { err -= dy; x += sx; } if (e2 < dx) { err += dx; y += sy; }
+//
+// starting from err = dx - dy. It steps the major axis every iteration,
+// and after k steps has taken n(k) = ceil((2*k*minor - major) / (2*major))
+// minor steps. That closed form lets the walk start and stop right at the
+// bitmap edges while producing exactly the pixels of the unclipped walk.
 void tigrLine(Tigr *bmp, int x0, int y0, int x1, int y1, TPixel color)
 {
-	int sx, sy, dx, dy, err, e2;
+	int sx, sy, dx, dy, major, minor, err, e2, a, dt, count;
+	long long klo, khi, lo, hi, n;
+	TPixel *td;
+
+	if (color.a == 0)
+		return;
+
 	dx = abs(x1 - x0);
 	dy = abs(y1 - y0);
 	if (x0 < x1) sx = 1; else sx = -1;
 	if (y0 < y1) sy = 1; else sy = -1;
-	err = dx - dy;
 
-	tigrPlot(bmp, x0, y0, color);
-	while (x0 != x1 || y0 != y1)
-	{
-		tigrPlot(bmp, x0, y0, color);
-		e2 = 2*err;
-		if (e2 > -dy) { err -= dy; x0 += sx; }
-		if (e2 <  dx) { err += dx; y0 += sy; }
+	// The end point is never drawn, except that a zero-length line is one pixel.
+	major = (dx > dy) ? dx : dy;
+	minor = (dx > dy) ? dy : dx;
+	if (major == 0)
+		major = 1;
+
+	// Clip along the major axis directly...
+	klo = 0;
+	khi = major - 1;
+	if (dx >= dy) tigrLineAxis(x0, sx, bmp->w, &lo, &hi);
+	else          tigrLineAxis(y0, sy, bmp->h, &lo, &hi);
+	if (lo > klo) klo = lo;
+	if (hi < khi) khi = hi;
+
+	// ...and along the minor one through the inverse of n(k).
+	if (dx >= dy) tigrLineAxis(y0, sy, bmp->h, &lo, &hi);
+	else          tigrLineAxis(x0, sx, bmp->w, &lo, &hi);
+	if (minor == 0) {
+		if (lo > 0 || hi < 0)
+			return;
+	} else {
+		if (lo > 0) {
+			lo = ((2*lo - 1) * major) / (2*(long long)minor) + 1;
+			if (lo > klo) klo = lo;
+		}
+		hi = (hi < 0) ? -1 : ((2*hi + 1) * major) / (2*(long long)minor);
+		if (hi < khi) khi = hi;
+	}
+	if (klo > khi)
+		return;
+
+	n = (2*klo*minor + major - 1) / (2*(long long)major);
+	count = (int)(khi - klo + 1);
+	dt = bmp->stride;
+	a = tigrBlendFactor(bmp, color);
+
+	if (dx >= dy) {
+		x0 += sx * (int)klo;
+		y0 += sy * (int)n;
+		err = (int)(dx - dy - klo*dy + n*dx);
+	} else {
+		x0 += sx * (int)n;
+		y0 += sy * (int)klo;
+		err = (int)(dx - dy + klo*dx - n*dy);
+	}
+	td = &bmp->pix[y0*dt + x0];
+
+	// Straight spans.
+	if (dy == 0) {
+		if (sx < 0)
+			td -= count - 1;
+		if (color.a == 0xff) {
+			tigrFillSpan(td, count, color, 0);
+		} else {
+			do { tigrBlendPixel(td++, color, a); } while (--count);
+		}
+		return;
+	}
+	if (dx == 0) {
+		dt *= sy;
+		if (color.a == 0xff) {
+			do { *td = color; td += dt; } while (--count);
+		} else {
+			do { tigrBlendPixel(td, color, a); td += dt; } while (--count);
+		}
+		return;
+	}
+
+	sy *= dt;
+	if (dx >= dy) {
+		if (color.a == 0xff) {
+			do {
+				*td = color;
+				e2 = 2*err; err -= dy; td += sx;
+				if (e2 < dx) { err += dx; td += sy; }
+			} while (--count);
+		} else {
+			do {
+				tigrBlendPixel(td, color, a);
+				e2 = 2*err; err -= dy; td += sx;
+				if (e2 < dx) { err += dx; td += sy; }
+			} while (--count);
+		}
+	} else {
+		if (color.a == 0xff) {
+			do {
+				*td = color;
+				e2 = 2*err; err += dx; td += sy;
+				if (e2 > -dy) { err -= dy; td += sx; }
+			} while (--count);
+		} else {
+			do {
+				tigrBlendPixel(td, color, a);
+				e2 = 2*err; err += dx; td += sy;
+				if (e2 > -dy) { err -= dy; td += sx; }
+			} while (--count);
+		}
+	}
+}
+
+// Clipped horizontal and vertical runs for rectangles. Opaque colors are
+// stored, anything else blends like tigrPlot.
+static void tigrHSpan(Tigr *bmp, int x, int y, int w, TPixel color)
+{
+	TPixel *td;
+	int a;
+
+	if (y < 0 || y >= bmp->h) return;
+	if (x < 0) { w += x; x = 0; }
+	if (x + w > bmp->w) { w = bmp->w - x; }
+	if (w <= 0) return;
+
+	td = &bmp->pix[y*bmp->stride + x];
+	if (color.a == 0xff) {
+		tigrFillSpan(td, w, color, 0);
+	} else if (color.a != 0) {
+		a = tigrBlendFactor(bmp, color);
+		do { tigrBlendPixel(td++, color, a); } while (--w);
+	}
+}
+
+static void tigrVSpan(Tigr *bmp, int x, int y, int h, TPixel color)
+{
+	TPixel *td;
+	int a, dt = bmp->stride;
+
+	if (x < 0 || x >= bmp->w) return;
+	if (y < 0) { h += y; y = 0; }
+	if (y + h > bmp->h) { h = bmp->h - y; }
+	if (h <= 0) return;
+
+	td = &bmp->pix[y*dt + x];
+	if (color.a == 0xff) {
+		do { *td = color; td += dt; } while (--h);
+	} else if (color.a != 0) {
+		a = tigrBlendFactor(bmp, color);
+		do { tigrBlendPixel(td, color, a); td += dt; } while (--h);
 	}
 }
 
+// Every outline pixel is drawn exactly once, corners included.
 void tigrRect(Tigr *bmp, int x, int y, int w, int h, TPixel color)
 {
-	int x1, y1;
 	if (w <= 0 || h <= 0)
 		return;
-	
-	x1 = x + w-1;
-	y1 = y + h-1;
-	tigrLine(bmp, x, y, x1, y, color);
-	tigrLine(bmp, x1, y, x1, y1, color);
-	tigrLine(bmp, x1, y1, x, y1, color);
-	tigrLine(bmp, x, y1, x, y, color);
+
+	tigrHSpan(bmp, x, y, w, color);
+	if (h > 1)
+		tigrHSpan(bmp, x, y + h-1, w, color);
+	if (h > 2) {
+		tigrVSpan(bmp, x, y + 1, h-2, color);
+		if (w > 1)
+			tigrVSpan(bmp, x + w-1, y + 1, h-2, color);
+	}
+}
+
+void tigrFillRect(Tigr *bmp, int x, int y, int w, int h, TPixel fill, TPixel outline)
+{
+	if (w <= 0 || h <= 0)
+		return;
+
+	tigrRect(bmp, x, y, w, h, outline);
+	if (w > 2 && h > 2)
+		tigrFill(bmp, x + 1, y + 1, w-2, h-2, fill);
+}
+
+void tigrFillRects(Tigr *bmp, const TigrRect *rects, int count)
+{
+	TPixel *td, color;
+	int i, x, y, w, h, a, dt = bmp->stride;
+
+	for (i=0;i<count;i++)
+	{
+		x = rects[i].x; y = rects[i].y;
+		w = rects[i].w; h = rects[i].h;
+		color = rects[i].color;
+
+		if (x < 0) { w += x; x = 0; }
+		if (y < 0) { h += y; y = 0; }
+		if (x + w > bmp->w) { w = bmp->w - x; }
+		if (y + h > bmp->h) { h = bmp->h - y; }
+		if (w <= 0 || h <= 0 || color.a == 0)
+			continue;
+
+		td = &bmp->pix[y*dt + x];
+		if (color.a == 0xff) {
+			// Most rects are a few pixels wide, plain stores beat a span call.
+			if (w <= 8) {
+				do {
+					for (x=0;x<w;x++)
+						td[x] = color;
+					td += dt;
+				} while (--h);
+			} else {
+				do {
+					tigrFillSpan(td, w, color, 0);
+					td += dt;
+				} while (--h);
+			}
+		} else {
+			a = tigrBlendFactor(bmp, color);
+			do {
+				for (x=0;x<w;x++)
+					tigrBlendPixel(&td[x], color, a);
+				td += dt;
+			} while (--h);
+		}
+	}
 }
 
 TPixel tigrGet(Tigr *bmp, int x, int y)
 {
 	TPixel empty = { 0,0,0,0 };
 	if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h)
-		return bmp->pix[y*bmp->w+x];
+		return bmp->pix[y*bmp->stride+x];
 	return empty;
 }
 
 void tigrPlot(Tigr *bmp, int x, int y, TPixel pix)
 {
-	int xa, i, a;
+	int i, a;
 	if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h)
 	{
-		xa = EXPAND(pix.a);
-		i = y*bmp->w+x;
+		i = y*bmp->stride+x;
 
-		a = xa * EXPAND(pix.a);
+		a = tigrBlendFactor(bmp, pix);
 		bmp->pix[i].r += (unsigned char)((pix.r - bmp->pix[i].r)*a >> 16);
 		bmp->pix[i].g += (unsigned char)((pix.g - bmp->pix[i].g)*a >> 16);
 		bmp->pix[i].b += (unsigned char)((pix.b - bmp->pix[i].b)*a >> 16);
@@ -297,10 +727,10 @@ void tigrBlit(Tigr *dst, Tigr *src, int dx, int dy, int sx, int sy, int w, int h
 	int st, dt;
 	CLIP();
 
-	ts = &src->pix[sy*src->w + sx];
-	td = &dst->pix[dy*dst->w + dx];
-	st = src->w;
-	dt = dst->w;
+	ts = &src->pix[sy*src->stride + sx];
+	td = &dst->pix[dy*dst->stride + dx];
+	st = src->stride;
+	dt = dst->stride;
 	do {
 		memcpy(td, ts, w*sizeof(TPixel));
 		ts += st;
@@ -308,149 +738,766 @@ void tigrBlit(Tigr *dst, Tigr *src, int dx, int dy, int sx, int sy, int w, int h
 	} while(--h);
 }
 
-void tigrBlitTint(Tigr *dst, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint)
+// Reference tint and blend for one row: each channel becomes
+// d + floor((s - d) * a / 65536), a = EXPAND(tint.a) * EXPAND(src.a).
+static void tigrBlitTintRowRef(TPixel *td, const TPixel *ts, int w, int xr, int xg, int xb, int xa)
 {
-	TPixel *td, *ts;
-	int x, st, dt, xr,xg,xb,xa;
-	CLIP();
-
-	xr = EXPAND(tint.r);
-	xg = EXPAND(tint.g);
-	xb = EXPAND(tint.b);
-	xa = EXPAND(tint.a);
-
-	ts = &src->pix[sy*src->w + sx];
-	td = &dst->pix[dy*dst->w + dx];
-	st = src->w;
-	dt = dst->w;
-	do {
-		for (x=0;x<w;x++)
-		{
-			unsigned r = (xr * ts[x].r) >> 8;
-			unsigned g = (xg * ts[x].g) >> 8;
-			unsigned b = (xb * ts[x].b) >> 8;
-			unsigned a = xa * EXPAND(ts[x].a);
-			td[x].r += (unsigned char)((r - td[x].r)*a >> 16);
-			td[x].g += (unsigned char)((g - td[x].g)*a >> 16);
-			td[x].b += (unsigned char)((b - td[x].b)*a >> 16);
-			td[x].a += (unsigned char)((ts[x].a - td[x].a)*a >> 16);
-		}
-		ts += st;
-		td += dt;
-	} while(--h);
+	int x;
+	for (x=0;x<w;x++)
+	{
+		unsigned r = (xr * ts[x].r) >> 8;
+		unsigned g = (xg * ts[x].g) >> 8;
+		unsigned b = (xb * ts[x].b) >> 8;
+		unsigned a = xa * EXPAND(ts[x].a);
+		td[x].r += (unsigned char)((r - td[x].r)*a >> 16);
+		td[x].g += (unsigned char)((g - td[x].g)*a >> 16);
+		td[x].b += (unsigned char)((b - td[x].b)*a >> 16);
+		td[x].a += (unsigned char)((ts[x].a - td[x].a)*a >> 16);
+	}
 }
 
-void tigrBlitAlpha(Tigr *dst, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, float alpha)
+#if defined(TIGR_SSE2)
+// The vector kernels work on pixels unpacked to 16-bit lanes. a never
+// exceeds 256*255 there: the one case where it would be 65536 (tint and
+// source both fully opaque) is the plain tinted source and gets selected
+// instead. pmulhuw gives floor(|s - d| * a / 65536); for negative
+// differences floor rounds away from zero, so one is added whenever the
+// pmullw low half shows a remainder.
+TIGR_INLINE __m128i tigrBlend16(__m128i s, __m128i d, __m128i a)
 {
-	alpha = (alpha < 0) ? 0 : (alpha > 1 ? 1 : alpha);
-	tigrBlitTint(dst, src, dx, dy, sx, sy, w, h, tigrRGBA(0xff,0xff,0xff,(unsigned char)(alpha*255)));
+	__m128i diff = _mm_sub_epi16(s, d);
+	__m128i sign = _mm_srai_epi16(diff, 15);
+	__m128i mag = _mm_sub_epi16(_mm_xor_si128(diff, sign), sign);
+	__m128i hi = _mm_mulhi_epu16(mag, a);
+	__m128i lo = _mm_mullo_epi16(mag, a);
+	hi = _mm_sub_epi16(hi, _mm_andnot_si128(_mm_cmpeq_epi16(lo, _mm_setzero_si128()), sign));
+	return _mm_add_epi16(d, _mm_sub_epi16(_mm_xor_si128(hi, sign), sign));
 }
 
-#undef CLIP0
-#undef CLIP1
-#undef CLIP
-
-//////// End of inlined file: tigr_bitmaps.c ////////
-
-//////// Start of inlined file: tigr_loadpng.c ////////
+// Two unpacked pixels: tint, blend, and take the tinted source where a = 65536.
+TIGR_INLINE __m128i tigrBlitTint16(__m128i s, __m128i d, __m128i tint, __m128i xa, int white, int opaque_tint)
+{
+	__m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+	__m128i ea = _mm_sub_epi16(sa, _mm_cmpgt_epi16(sa, _mm_setzero_si128()));
+	__m128i r;
 
-//#include "tigr_internal.h"
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
+	if (!white)
+		s = _mm_srli_epi16(_mm_mullo_epi16(s, tint), 8);
 
-typedef struct {
-	const unsigned char *p, *end;
-} PNG;
+	r = tigrBlend16(s, d, _mm_mullo_epi16(ea, xa));
+	if (opaque_tint) {
+		__m128i full = _mm_cmpeq_epi16(sa, _mm_set1_epi16(0xff));
+		r = _mm_or_si128(_mm_and_si128(full, s), _mm_andnot_si128(full, r));
+	}
+	return r;
+}
+#endif
 
-static unsigned get32(const unsigned char *v)
+#if defined(TIGR_AVX2)
+TIGR_INLINE __m256i tigrBlend16x2(__m256i s, __m256i d, __m256i a)
 {
-	return (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+	__m256i diff = _mm256_sub_epi16(s, d);
+	__m256i sign = _mm256_srai_epi16(diff, 15);
+	__m256i mag = _mm256_sub_epi16(_mm256_xor_si256(diff, sign), sign);
+	__m256i hi = _mm256_mulhi_epu16(mag, a);
+	__m256i lo = _mm256_mullo_epi16(mag, a);
+	hi = _mm256_sub_epi16(hi, _mm256_andnot_si256(_mm256_cmpeq_epi16(lo, _mm256_setzero_si256()), sign));
+	return _mm256_add_epi16(d, _mm256_sub_epi16(_mm256_xor_si256(hi, sign), sign));
 }
 
-static const unsigned char *find(PNG *png, const char *chunk, unsigned minlen)
+TIGR_INLINE __m256i tigrBlitTint16x2(__m256i s, __m256i d, __m256i tint, __m256i xa, int white, int opaque_tint)
 {
-	const unsigned char *start;
-	while (png->p < png->end)
-	{
-		unsigned len = get32(png->p+0);
-		start = png->p;
-		png->p += len + 12;
-		if (memcmp(start+4, chunk, 4) == 0 && len >= minlen && png->p <= png->end)
-			return start+8;
-	}
+	__m256i sa = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+	__m256i ea = _mm256_sub_epi16(sa, _mm256_cmpgt_epi16(sa, _mm256_setzero_si256()));
+	__m256i r;
 
-	return NULL;
-}
+	if (!white)
+		s = _mm256_srli_epi16(_mm256_mullo_epi16(s, tint), 8);
 
-static unsigned char paeth(unsigned char a, unsigned char b, unsigned char c)
-{
-	int p  = a + b - c;
-	int pa = abs(p-a), pb = abs(p-b), pc = abs(p-c);
-	return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+	r = tigrBlend16x2(s, d, _mm256_mullo_epi16(ea, xa));
+	if (opaque_tint) {
+		__m256i full = _mm256_cmpeq_epi16(sa, _mm256_set1_epi16(0xff));
+		r = _mm256_or_si256(_mm256_and_si256(full, s), _mm256_andnot_si256(full, r));
+	}
+	return r;
 }
+#endif
 
-static int unfilter(int w, int h, int bpp, unsigned char *raw)
+// Vector rows with whole-block shortcuts: fully transparent source pixels
+// leave the destination alone, and fully opaque ones under an opaque tint
+// are a (tinted) copy.
+static void tigrBlitTintRow(TPixel *td, const TPixel *ts, int w, int xr, int xg, int xb, int xa)
 {
-	int len = w * bpp, x, y;
-	unsigned char *prev = raw;
-	for (y=0;y<h;y++,prev=raw,raw+=len)
+	int x = 0;
+#if defined(TIGR_SSE2)
+	int white = xr == 256 && xg == 256 && xb == 256;
+	int opaque_tint = xa == 256;
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi32(-1);
+	__m128i tint = _mm_set_epi16(256, (short)xr, (short)xg, (short)xb, 256, (short)xr, (short)xg, (short)xb);
+	__m128i alpha = _mm_set1_epi16((short)xa);
+
+#if defined(TIGR_AVX2)
+	__m256i zero8 = _mm256_setzero_si256();
+	__m256i ones8 = _mm256_set1_epi32(-1);
+	__m256i tint8 = _mm256_set_m128i(tint, tint);
+	__m256i alpha8 = _mm256_set1_epi16((short)xa);
+
+	for (;x+8<=w;x+=8)
 	{
-#define LOOP(A, B) for (x=0;x<bpp;x++) raw[x] += A; for (;x<len;x++) raw[x] += B; break
-		switch (*raw++)
-		{
-		case 0: break;
-		case 1: LOOP(0,         raw[x-bpp]);
-		case 2: LOOP(prev[x],   prev[x]);
-		case 3: LOOP(prev[x]/2, (raw[x-bpp] + prev[x])/2);
-		case 4: LOOP(prev[x],   paeth(raw[x-bpp], prev[x], prev[x-bpp]));
-		default: return 0;
+		__m256i s = _mm256_loadu_si256((const __m256i *)(ts + x));
+		unsigned clear = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(s, zero8)) & 0x88888888u;
+		unsigned solid = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(s, ones8)) & 0x88888888u;
+		__m256i d, lo, hi;
+
+		if (clear == 0x88888888u)
+			continue;
+		if (opaque_tint && white && solid == 0x88888888u) {
+			_mm256_storeu_si256((__m256i *)(td + x), s);
+			continue;
 		}
-#undef LOOP
+
+		d = _mm256_loadu_si256((const __m256i *)(td + x));
+		lo = tigrBlitTint16x2(_mm256_unpacklo_epi8(s, zero8), _mm256_unpacklo_epi8(d, zero8), tint8, alpha8, white, opaque_tint);
+		hi = tigrBlitTint16x2(_mm256_unpackhi_epi8(s, zero8), _mm256_unpackhi_epi8(d, zero8), tint8, alpha8, white, opaque_tint);
+		_mm256_storeu_si256((__m256i *)(td + x), _mm256_packus_epi16(lo, hi));
 	}
-	return 1;
-}
+#endif
 
-static void convert(int bpp, int w, int h, unsigned char *src, TPixel *dest)
-{
-	int x,y;
-	for (y=0;y<h;y++)
+	for (;x+4<=w;x+=4)
 	{
-		src++; // skip filter byte
-		for (x=0;x<w;x++,src+=bpp)
-		{
-			switch (bpp) {
-			case 1: *dest++ = tigrRGB (src[0], src[0], src[0]); break;
-			case 2: *dest++ = tigrRGBA(src[0], src[0], src[0], src[1]); break;
-			case 3: *dest++ = tigrRGB (src[0], src[1], src[2]); break;
-			case 4: *dest++ = tigrRGBA(src[0], src[1], src[2], src[3]); break;
-			}
+		__m128i s = _mm_loadu_si128((const __m128i *)(ts + x));
+		int clear = _mm_movemask_epi8(_mm_cmpeq_epi8(s, zero)) & 0x8888;
+		int solid = _mm_movemask_epi8(_mm_cmpeq_epi8(s, ones)) & 0x8888;
+		__m128i d, lo, hi;
+
+		if (clear == 0x8888)
+			continue;
+		if (opaque_tint && white && solid == 0x8888) {
+			_mm_storeu_si128((__m128i *)(td + x), s);
+			continue;
 		}
+
+		d = _mm_loadu_si128((const __m128i *)(td + x));
+		lo = tigrBlitTint16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), tint, alpha, white, opaque_tint);
+		hi = tigrBlitTint16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), tint, alpha, white, opaque_tint);
+		_mm_storeu_si128((__m128i *)(td + x), _mm_packus_epi16(lo, hi));
 	}
+#endif
+
+	tigrBlitTintRowRef(td + x, ts + x, w - x, xr, xg, xb, xa);
 }
 
-static void depalette(int w, int h, unsigned char *src, TPixel *dest, const unsigned char *plte)
+// Reference row for premultiplied sources: tint every channel, alpha
+// included, then d = s + d * (256 - EXPAND(s.a)) / 256.
+static void tigrBlitOverRowRef(TPixel *td, const TPixel *ts, int w, int xr, int xg, int xb, int xa)
 {
-	int x,y,c;
-	for (y=0;y<h;y++)
+	int x;
+	for (x=0;x<w;x++)
 	{
-		src++; // skip filter byte
-		for (x=0;x<w;x++,src++)
-		{
-			c = src[0];
-			*dest++ = tigrRGBA(plte[c*3+0], plte[c*3+1], plte[c*3+2], c?255:0);
-		}
+		unsigned a = (xa * ts[x].a) >> 8;
+		unsigned ia = 256 - EXPAND(a);
+		td[x].r = (unsigned char)(((xr * ts[x].r) >> 8) + ((td[x].r * ia) >> 8));
+		td[x].g = (unsigned char)(((xg * ts[x].g) >> 8) + ((td[x].g * ia) >> 8));
+		td[x].b = (unsigned char)(((xb * ts[x].b) >> 8) + ((td[x].b * ia) >> 8));
+		td[x].a = (unsigned char)(a + ((td[x].a * ia) >> 8));
 	}
 }
 
-#define FAIL() { errno = EINVAL; goto err; }
-#define CHECK(X) if (!(X)) FAIL()
-static int outsize(Tigr *bmp, int bpp) { return (bmp->w+1)*bmp->h * bpp; }
-
-static Tigr *tigrLoadPng(PNG *png)
+#if defined(TIGR_SSE2)
+TIGR_INLINE __m128i tigrBlitOver16(__m128i s, __m128i d, __m128i tint, int white)
+{
+	__m128i sa, ia;
+	if (!white)
+		s = _mm_srli_epi16(_mm_mullo_epi16(s, tint), 8);
+	sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+	ia = _mm_add_epi16(_mm_sub_epi16(_mm_set1_epi16(256), sa), _mm_cmpgt_epi16(sa, _mm_setzero_si128()));
+	return _mm_add_epi16(s, _mm_srli_epi16(_mm_mullo_epi16(d, ia), 8));
+}
+#endif
+
+#if defined(TIGR_AVX2)
+TIGR_INLINE __m256i tigrBlitOver16x2(__m256i s, __m256i d, __m256i tint, int white)
+{
+	__m256i sa, ia;
+	if (!white)
+		s = _mm256_srli_epi16(_mm256_mullo_epi16(s, tint), 8);
+	sa = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+	ia = _mm256_add_epi16(_mm256_sub_epi16(_mm256_set1_epi16(256), sa), _mm256_cmpgt_epi16(sa, _mm256_setzero_si256()));
+	return _mm256_add_epi16(s, _mm256_srli_epi16(_mm256_mullo_epi16(d, ia), 8));
+}
+#endif
+
+// Transparent premultiplied pixels are all zero, so a whole block of them
+// is found with one compare. Opaque blocks under a white tint are copies.
+static void tigrBlitOverRow(TPixel *td, const TPixel *ts, int w, int xr, int xg, int xb, int xa)
+{
+	int x = 0;
+#if defined(TIGR_SSE2)
+	int white = xr == 256 && xg == 256 && xb == 256 && xa == 256;
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi32(-1);
+	__m128i tint = _mm_set_epi16((short)xa, (short)xr, (short)xg, (short)xb, (short)xa, (short)xr, (short)xg, (short)xb);
+
+#if defined(TIGR_AVX2)
+	__m256i zero8 = _mm256_setzero_si256();
+	__m256i ones8 = _mm256_set1_epi32(-1);
+	__m256i tint8 = _mm256_set_m128i(tint, tint);
+
+	for (;x+8<=w;x+=8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)(ts + x));
+		__m256i d, lo, hi;
+
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero8)) == -1)
+			continue;
+		if (white && ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(s, ones8)) & 0x88888888u) == 0x88888888u) {
+			_mm256_storeu_si256((__m256i *)(td + x), s);
+			continue;
+		}
+
+		d = _mm256_loadu_si256((const __m256i *)(td + x));
+		lo = tigrBlitOver16x2(_mm256_unpacklo_epi8(s, zero8), _mm256_unpacklo_epi8(d, zero8), tint8, white);
+		hi = tigrBlitOver16x2(_mm256_unpackhi_epi8(s, zero8), _mm256_unpackhi_epi8(d, zero8), tint8, white);
+		_mm256_storeu_si256((__m256i *)(td + x), _mm256_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (;x+4<=w;x+=4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)(ts + x));
+		__m128i d, lo, hi;
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff)
+			continue;
+		if (white && (_mm_movemask_epi8(_mm_cmpeq_epi8(s, ones)) & 0x8888) == 0x8888) {
+			_mm_storeu_si128((__m128i *)(td + x), s);
+			continue;
+		}
+
+		d = _mm_loadu_si128((const __m128i *)(td + x));
+		lo = tigrBlitOver16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), tint, white);
+		hi = tigrBlitOver16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), tint, white);
+		_mm_storeu_si128((__m128i *)(td + x), _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	tigrBlitOverRowRef(td + x, ts + x, w - x, xr, xg, xb, xa);
+}
+
+// Blends h rows of w pixels. The tint is expanded, and premultiplied when
+// the source is.
+static void tigrBlitTintRows(TPixel *td, int dt, const TPixel *ts, int st, int w, int h,
+	int xr, int xg, int xb, int xa, int premultiplied)
+{
+	if (premultiplied) {
+		do {
+			tigrBlitOverRow(td, ts, w, xr, xg, xb, xa);
+			ts += st;
+			td += dt;
+		} while(--h);
+		return;
+	}
+
+	do {
+		tigrBlitTintRow(td, ts, w, xr, xg, xb, xa);
+		ts += st;
+		td += dt;
+	} while(--h);
+}
+
+void tigrBlitTint(Tigr *dst, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint)
+{
+	int xr,xg,xb,xa;
+	CLIP();
+
+	// A zero blend factor leaves every destination pixel as it was.
+	if (tint.a == 0)
+		return;
+
+	xr = EXPAND(tint.r);
+	xg = EXPAND(tint.g);
+	xb = EXPAND(tint.b);
+	xa = EXPAND(tint.a);
+
+	if (src->premultiplied) {
+		// The tint is premultiplied as well.
+		xr = (xr * xa) >> 8;
+		xg = (xg * xa) >> 8;
+		xb = (xb * xa) >> 8;
+	}
+
+	tigrBlitTintRows(&dst->pix[dy*dst->stride + dx], dst->stride, &src->pix[sy*src->stride + sx], src->stride,
+		w, h, xr, xg, xb, xa, src->premultiplied);
+}
+
+void tigrBlitAlpha(Tigr *dst, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, float alpha)
+{
+	alpha = (alpha < 0) ? 0 : (alpha > 1 ? 1 : alpha);
+	tigrBlitTint(dst, src, dx, dy, sx, sy, w, h, tigrRGBA(0xff,0xff,0xff,(unsigned char)(alpha*255)));
+}
+
+// Rows per tigrBlitBatch band.
+#define TIGR_BATCH_BAND 32
+
+// One clipped tigrBlitBatch sprite, with its tint already expanded.
+typedef struct {
+	TPixel *td;
+	const TPixel *ts;
+	int dy, w, h; // top row and size of what is left to draw
+	int xr, xg, xb, xa;
+} TigrBatchItem;
+
+void tigrBlitBatch(Tigr *dst, Tigr *src, const TigrSprite *sprites, int count)
+{
+	TigrBatchItem local_items[64], *items, *it;
+	int local_indices[3*64 + 64 + 1];
+	int *indices, *sorted, *active, *merged, *start, *swap;
+	TPixel tint;
+	int i, j, k, n, band, bands, first, last, live, end, rows;
+	int dx, dy, sx, sy, w, h;
+
+	if (count <= 0)
+		return;
+
+	bands = (dst->h + TIGR_BATCH_BAND - 1) / TIGR_BATCH_BAND;
+	items = local_items;
+	indices = local_indices;
+	if (count > 64 || bands > 64) {
+		items = (TigrBatchItem *)malloc(count * sizeof(TigrBatchItem));
+		indices = (int *)malloc((3*count + bands + 1) * sizeof(int));
+		if (!items || !indices) {
+			free(items);
+			free(indices);
+			for (i=0;i<count;i++)
+				tigrBlitTint(dst, src, sprites[i].dx, sprites[i].dy, sprites[i].sx, sprites[i].sy,
+					sprites[i].w, sprites[i].h, sprites[i].tint);
+			return;
+		}
+	}
+	sorted = indices;
+	active = sorted + count;
+	merged = active + count;
+	start = merged + count;
+
+	// Clip everything once.
+	n = 0;
+	for (i=0;i<count;i++)
+	{
+		dx = sprites[i].dx; dy = sprites[i].dy;
+		sx = sprites[i].sx; sy = sprites[i].sy;
+		w = sprites[i].w; h = sprites[i].h;
+		tint = sprites[i].tint;
+
+		CLIP0(dx, sx, w);
+		CLIP0(dy, sy, h);
+		CLIP0(sx, dx, w);
+		CLIP0(sy, dy, h);
+		CLIP1(dx, dst->w, w);
+		CLIP1(dy, dst->h, h);
+		CLIP1(sx, src->w, w);
+		CLIP1(sy, src->h, h);
+		if (w <= 0 || h <= 0 || tint.a == 0)
+			continue;
+
+		it = &items[n++];
+		it->td = &dst->pix[dy*dst->stride + dx];
+		it->ts = &src->pix[sy*src->stride + sx];
+		it->dy = dy;
+		it->w = w;
+		it->h = h;
+		it->xr = EXPAND(tint.r);
+		it->xg = EXPAND(tint.g);
+		it->xb = EXPAND(tint.b);
+		it->xa = EXPAND(tint.a);
+		if (src->premultiplied) {
+			it->xr = (it->xr * it->xa) >> 8;
+			it->xg = (it->xg * it->xa) >> 8;
+			it->xb = (it->xb * it->xa) >> 8;
+		}
+	}
+
+	// Counting sort by the band each sprite starts in. It is stable, so
+	// within a band the sprites stay in submission order.
+	memset(start, 0, (bands + 1) * sizeof(int));
+	for (i=0;i<n;i++)
+		start[items[i].dy / TIGR_BATCH_BAND + 1]++;
+	for (band=0;band<bands;band++)
+		start[band+1] += start[band];
+	for (i=0;i<n;i++)
+		sorted[start[items[i].dy / TIGR_BATCH_BAND]++] = i;
+	for (band=bands;band>0;band--)
+		start[band] = start[band-1];
+	start[0] = 0;
+
+	// Sweep the destination top to bottom a band at a time. The sprites
+	// crossing a band are drawn in submission order, so every pixel sees
+	// the same sequence of blends as with one tigrBlitTint per sprite.
+	live = 0;
+	for (band=0;band<bands;band++)
+	{
+		first = start[band];
+		last = start[band+1];
+		if (live == 0 && first == last)
+			continue;
+		end = (band + 1) * TIGR_BATCH_BAND;
+
+		// Merge the sprites starting here with those carried over.
+		for (i=0,j=first,k=0;i<live || j<last;) {
+			if (j == last || (i < live && active[i] < sorted[j]))
+				merged[k++] = active[i++];
+			else
+				merged[k++] = sorted[j++];
+		}
+		swap = active; active = merged; merged = swap;
+		live = k;
+
+		for (i=0,k=0;i<live;i++)
+		{
+			it = &items[active[i]];
+			rows = end - it->dy < it->h ? end - it->dy : it->h;
+			tigrBlitTintRows(it->td, dst->stride, it->ts, src->stride, it->w, rows,
+				it->xr, it->xg, it->xb, it->xa, src->premultiplied);
+			it->td += rows*dst->stride;
+			it->ts += rows*src->stride;
+			it->dy += rows;
+			it->h -= rows;
+			if (it->h)
+				active[k++] = active[i];
+		}
+		live = k;
+	}
+
+	if (items != local_items) {
+		free(items);
+		free(indices);
+	}
+}
+
+// Writes pixels [x0, x1) of a source row scaled up by a whole factor k.
+static void tigrScaleRowNearest(TPixel *td, const TPixel *ts, int k, int x0, int x1)
+{
+	const TPixel *s;
+	int x = x0, i;
+
+	if (k == 1) {
+		memcpy(td, ts + x0, (x1 - x0)*sizeof(TPixel));
+		return;
+	}
+
+	// Finish a source pixel cut by the left edge.
+	s = ts + x0 / k;
+	i = x0 % k;
+	if (i) {
+		for (;i<k && x<x1;i++,x++)
+			*td++ = *s;
+		s++;
+	}
+
+#ifdef TIGR_SSE2
+	if (k == 2) {
+		for (;x+8<=x1;x+=8,s+=4,td+=8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)s);
+			_mm_storeu_si128((__m128i *)td, _mm_shuffle_epi32(v, _MM_SHUFFLE(1,1,0,0)));
+			_mm_storeu_si128((__m128i *)(td + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,2,2)));
+		}
+	} else if (k == 3) {
+		for (;x+12<=x1;x+=12,s+=4,td+=12) {
+			__m128i v = _mm_loadu_si128((const __m128i *)s);
+			_mm_storeu_si128((__m128i *)td, _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,0,0)));
+			_mm_storeu_si128((__m128i *)(td + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,1,1)));
+			_mm_storeu_si128((__m128i *)(td + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,2)));
+		}
+	} else if (k == 4) {
+		for (;x+16<=x1;x+=16,s+=4,td+=16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)s);
+			_mm_storeu_si128((__m128i *)td, _mm_shuffle_epi32(v, _MM_SHUFFLE(0,0,0,0)));
+			_mm_storeu_si128((__m128i *)(td + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(1,1,1,1)));
+			_mm_storeu_si128((__m128i *)(td + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,2,2)));
+			_mm_storeu_si128((__m128i *)(td + 12), _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,3)));
+		}
+	}
+#endif
+	if (k >= 4) {
+		for (;x+k<=x1;x+=k,s++,td+=k)
+			tigrFillSpan(td, k, *s, 0);
+	}
+
+	for (i=0;x<x1;x++) {
+		*td++ = *s;
+		if (++i == k) { i = 0; s++; }
+	}
+}
+
+// out = a + (b - a) * f / 256, rounded, for n pixels.
+static void tigrLerpRows(TPixel *out, const TPixel *a, const TPixel *b, int n, int f)
+{
+	int i = 0, g = 256 - f;
+
+#ifdef TIGR_SSE2
+	__m128i zero = _mm_setzero_si128();
+	__m128i wa = _mm_set1_epi16((short)g), wb = _mm_set1_epi16((short)f);
+	__m128i half = _mm_set1_epi16(128);
+	for (;i+4<=n;i+=4) {
+		// At most 255*256 + 128, which still fits unsigned 16 bits.
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), wa), _mm_mullo_epi16(_mm_unpacklo_epi8(y, zero), wb));
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), wa), _mm_mullo_epi16(_mm_unpackhi_epi8(y, zero), wb));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for (;i<n;i++) {
+		out[i].r = (unsigned char)((a[i].r*g + b[i].r*f + 128) >> 8);
+		out[i].g = (unsigned char)((a[i].g*g + b[i].g*f + 128) >> 8);
+		out[i].b = (unsigned char)((a[i].b*g + b[i].b*f + 128) >> 8);
+		out[i].a = (unsigned char)((a[i].a*g + b[i].a*f + 128) >> 8);
+	}
+}
+
+#ifdef TIGR_SSE2
+// Blends row[0] and row[1] with the weight pair w = (256 - f) | f << 16,
+// leaving the four unshifted channel sums in 32-bit lanes.
+TIGR_INLINE __m128i tigrLerpPair(const TPixel *row, int w)
+{
+	__m128i v = _mm_loadl_epi64((const __m128i *)row);
+	v = _mm_unpacklo_epi8(v, _mm_srli_si128(v, 4));
+	v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+	return _mm_madd_epi16(v, _mm_set1_epi32(w));
+}
+#endif
+
+// Horizontal bilinear pass: td[i] blends row[xs[i]] and row[xs[i] + 1]
+// with the weight pair xw[i].
+static void tigrLerpColumns(TPixel *td, const TPixel *row, const int *xs, const int *xw, int n)
+{
+	const TPixel *p;
+	int i = 0, f, g;
+
+#ifdef TIGR_SSE2
+	__m128i half = _mm_set1_epi32(128);
+	for (;i+4<=n;i+=4) {
+		__m128i p0 = _mm_srli_epi32(_mm_add_epi32(tigrLerpPair(row + xs[i], xw[i]), half), 8);
+		__m128i p1 = _mm_srli_epi32(_mm_add_epi32(tigrLerpPair(row + xs[i+1], xw[i+1]), half), 8);
+		__m128i p2 = _mm_srli_epi32(_mm_add_epi32(tigrLerpPair(row + xs[i+2], xw[i+2]), half), 8);
+		__m128i p3 = _mm_srli_epi32(_mm_add_epi32(tigrLerpPair(row + xs[i+3], xw[i+3]), half), 8);
+		_mm_storeu_si128((__m128i *)(td + i), _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+	}
+#endif
+	for (;i<n;i++) {
+		p = row + xs[i];
+		g = xw[i] & 0xffff;
+		f = xw[i] >> 16;
+		td[i].r = (unsigned char)((p[0].r*g + p[1].r*f + 128) >> 8);
+		td[i].g = (unsigned char)((p[0].g*g + p[1].g*f + 128) >> 8);
+		td[i].b = (unsigned char)((p[0].b*g + p[1].b*f + 128) >> 8);
+		td[i].a = (unsigned char)((p[0].a*g + p[1].a*f + 128) >> 8);
+	}
+}
+
+// Source position of a destination pixel centre, in 1/256ths, with the
+// pixel to its right clamped to the edge.
+static void tigrScaleSample(int i, int size, int scaled, int *index, int *frac)
+{
+	long long pos = ((2*(long long)i + 1) * size * 256) / (2*(long long)scaled) - 128;
+	if (pos < 0)
+		pos = 0;
+	*index = (int)(pos >> 8);
+	*frac = (int)(pos & 255);
+	if (*index >= size - 1) {
+		*index = size - 1;
+		*frac = 0;
+	}
+}
+
+void tigrBlitScaledRows(Tigr *dst, Tigr *src, int dx, int dy, int dw, int dh, int y0, int y1)
+{
+	TPixel *td, *row;
+	int *xs, *xw;
+	int x0, x1, y, kx, ky, sy, fy, i, f, lo, hi, last_sy, last_fy;
+
+	if (dw <= 0 || dh <= 0 || src->w <= 0 || src->h <= 0)
+		return;
+
+	// Clip the scaled rect, and the requested rows, to the destination.
+	x0 = dx < 0 ? -dx : 0;
+	x1 = dx + dw > dst->w ? dst->w - dx : dw;
+	if (y0 < 0) y0 = 0;
+	if (y0 < -dy) y0 = -dy;
+	if (y1 > dh) y1 = dh;
+	if (y1 > dst->h - dy) y1 = dst->h - dy;
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	// Whole-number factors just repeat pixels.
+	if (dw % src->w == 0 && dh % src->h == 0) {
+		kx = dw / src->w;
+		ky = dh / src->h;
+		for (y=y0;y<y1;y++) {
+			td = &dst->pix[(dy + y)*dst->stride + dx + x0];
+			if (y > y0 && y % ky)
+				memcpy(td, td - dst->stride, (x1 - x0)*sizeof(TPixel));
+			else
+				tigrScaleRowNearest(td, &src->pix[(y / ky)*src->stride], kx, x0, x1);
+		}
+		return;
+	}
+
+	// Bilinear: a vertical pass into a scratch row, then a horizontal one
+	// through a per-column table of source pixels and weights.
+	xs = (int *)malloc((x1 - x0) * 2 * sizeof(int));
+	row = (TPixel *)malloc((src->w + 1) * sizeof(TPixel));
+	if (!xs || !row) {
+		free(xs);
+		free(row);
+		return;
+	}
+	xw = xs + (x1 - x0);
+
+	for (i=0;i<x1-x0;i++) {
+		tigrScaleSample(x0 + i, src->w, dw, &xs[i], &f);
+		xw[i] = (256 - f) | (f << 16);
+	}
+	// Source columns the pass reads. At the right edge the second pixel of
+	// the pair has zero weight, so it only needs to be readable.
+	lo = xs[0];
+	hi = xs[x1 - x0 - 1] + 1;
+	if (hi == src->w) {
+		hi = src->w - 1;
+		row[src->w] = src->pix[0];
+	}
+
+	last_sy = last_fy = -1;
+	for (y=y0;y<y1;y++) {
+		tigrScaleSample(y, src->h, dh, &sy, &fy);
+		if (sy != last_sy || fy != last_fy) {
+			if (fy)
+				tigrLerpRows(row + lo, &src->pix[sy*src->stride + lo], &src->pix[(sy + 1)*src->stride + lo], hi - lo + 1, fy);
+			else
+				memcpy(row + lo, &src->pix[sy*src->stride + lo], (hi - lo + 1)*sizeof(TPixel));
+			last_sy = sy;
+			last_fy = fy;
+		}
+		tigrLerpColumns(&dst->pix[(dy + y)*dst->stride + dx + x0], row, xs, xw, x1 - x0);
+	}
+
+	free(xs);
+	free(row);
+}
+
+void tigrBlitScaled(Tigr *dst, Tigr *src, int dx, int dy, int dw, int dh)
+{
+	tigrBlitScaledRows(dst, src, dx, dy, dw, dh, 0, dh);
+}
+
+#undef TIGR_BATCH_BAND
+#undef CLIP0
+#undef CLIP1
+#undef CLIP
+
+//////// End of inlined file: tigr_bitmaps.c ////////
+
+//////// Start of inlined file: tigr_loadpng.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef struct {
+	const unsigned char *p, *end;
+} PNG;
+
+static unsigned get32(const unsigned char *v)
+{
+	return (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+}
+
+static const unsigned char *find(PNG *png, const char *chunk, unsigned minlen)
+{
+	const unsigned char *start;
+	while (png->p < png->end)
+	{
+		unsigned len = get32(png->p+0);
+		start = png->p;
+		png->p += len + 12;
+		if (memcmp(start+4, chunk, 4) == 0 && len >= minlen && png->p <= png->end)
+			return start+8;
+	}
+
+	return NULL;
+}
+
+static unsigned char paeth(unsigned char a, unsigned char b, unsigned char c)
+{
+	int p  = a + b - c;
+	int pa = abs(p-a), pb = abs(p-b), pc = abs(p-c);
+	return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+static int unfilter(int w, int h, int bpp, unsigned char *raw)
+{
+	int len = w * bpp, x, y;
+	unsigned char *prev = raw;
+	for (y=0;y<h;y++,prev=raw,raw+=len)
+	{
+#define LOOP(A, B) for (x=0;x<bpp;x++) raw[x] += A; for (;x<len;x++) raw[x] += B; break
+		switch (*raw++)
+		{
+		case 0: break;
+		case 1: LOOP(0,         raw[x-bpp]);
+		case 2: LOOP(prev[x],   prev[x]);
+		case 3: LOOP(prev[x]/2, (raw[x-bpp] + prev[x])/2);
+		case 4: LOOP(prev[x],   paeth(raw[x-bpp], prev[x], prev[x-bpp]));
+		default: return 0;
+		}
+#undef LOOP
+	}
+	return 1;
+}
+
+static void convert(int bpp, int w, int h, unsigned char *src, TPixel *dest)
+{
+	int x,y;
+	for (y=0;y<h;y++)
+	{
+		src++; // skip filter byte
+		for (x=0;x<w;x++,src+=bpp)
+		{
+			switch (bpp) {
+			case 1: *dest++ = tigrRGB (src[0], src[0], src[0]); break;
+			case 2: *dest++ = tigrRGBA(src[0], src[0], src[0], src[1]); break;
+			case 3: *dest++ = tigrRGB (src[0], src[1], src[2]); break;
+			case 4: *dest++ = tigrRGBA(src[0], src[1], src[2], src[3]); break;
+			}
+		}
+	}
+}
+
+static void depalette(int w, int h, unsigned char *src, TPixel *dest, const unsigned char *plte)
+{
+	int x,y,c;
+	for (y=0;y<h;y++)
+	{
+		src++; // skip filter byte
+		for (x=0;x<w;x++,src++)
+		{
+			c = src[0];
+			*dest++ = tigrRGBA(plte[c*3+0], plte[c*3+1], plte[c*3+2], c?255:0);
+		}
+	}
+}
+
+#define FAIL() { errno = EINVAL; goto err; }
+#define CHECK(X) if (!(X)) FAIL()
+static int outsize(Tigr *bmp, int bpp) { return (bmp->w+1)*bmp->h * bpp; }
+
+static Tigr *tigrLoadPng(PNG *png)
 {
 	const unsigned char *ihdr, *idat, *plte, *first;
-	int depth, ctype, bpp;
+	int depth, ctype, bpp, y;
 	int datalen = 0;
 	unsigned char *data = NULL, *out;
 	Tigr *bmp = NULL;
@@ -512,6 +1559,11 @@ static Tigr *tigrLoadPng(PNG *png)
 	} else {
 		convert(bpp, bmp->w, bmp->h, out, bmp->pix);
 	}
+
+	// The rows came out packed, spread them to the stride. Last row first,
+	// each one only moves forward.
+	for (y=bmp->h-1;y>0;y--)
+		memmove(bmp->pix + y*bmp->stride, bmp->pix + y*bmp->w, bmp->w*sizeof(TPixel));
 	
 	free(data);
 	return bmp;
@@ -559,356 +1611,1478 @@ Tigr *tigrLoadImage(const char *fileName)
 #include <string.h>
 #include <errno.h>
 
+#define SAVE_WINDOW 32768
+#define SAVE_HASH_BITS 15
+#define SAVE_MIN_MATCH 3
+#define SAVE_MAX_MATCH 258
+#define SAVE_DEFAULT_LEVEL 6
+#define SAVE_BLOCK_TOKENS 65536
+#define SAVE_SPLIT_TOKENS 4096
+#define SAVE_SPLIT_BITS 512
+
 typedef struct {
-	unsigned crc, adler, bits, prev, runlen;
-	FILE *out;
-	unsigned crcTable[256];
+	unsigned char *out;  // the PNG so far, grown as needed
+	size_t len, cap, chunk;
+	int failed;
+	unsigned bits, count;
+	unsigned crcTable[8][256];
+	// Literal/length codes, then distance codes from 288. Bit-reversed,
+	// ready for putbits.
+	unsigned short codes[288+32], fixedCodes[288+32];
+	unsigned char lens[288+32], fixedLens[288+32];
+	unsigned char lenSym[SAVE_MAX_MATCH+1];
+	unsigned char distSym[512];
+
+	// The block being gathered. Tokens are literal bytes, or matches as
+	// (distance << 9) | length, and cover data[blockStart, blockEnd).
+	// freq counts their symbols in the same layout as the codes, splitFreq
+	// just the ones since splitToken, where the last split check was.
+	const unsigned char *data;
+	unsigned *tokens;
+	int tokenCount, splitToken;
+	int blockStart, blockEnd, splitStart;
+	unsigned freq[288+32], splitFreq[288+32];
 } Save;
 
-static const unsigned crctable[16] = { 0, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
-	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c };
+// LZ77 effort for each compression level, after zlib's table.
+typedef struct {
+	unsigned short good;   // search a quarter of the chain past a match this long
+	unsigned short lazy;   // lazy levels: keep a match this long without looking ahead,
+	                       // greedy levels: don't index the inside of longer matches
+	unsigned short nice;   // stop searching at a match this long
+	unsigned short chain;  // most hash chain links followed per search
+} SaveLevel;
+
+static const SaveLevel saveLevels[10] = {
+	{  0,   0,   0,    0 }, // stored
+	{  4,   4,   8,    4 }, // greedy
+	{  4,   5,  16,    8 },
+	{  4,   6,  32,   32 },
+	{  4,   4,  16,   16 }, // lazy
+	{  8,  16,  32,   32 },
+	{  8,  16, 128,  128 },
+	{  8,  32, 128,  256 },
+	{ 32, 128, 258, 1024 },
+	{ 32, 258, 258, 4096 },
+};
+
+static const unsigned short saveLenBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const unsigned char saveLenBits[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const unsigned short saveDistBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const unsigned char saveDistBits[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static int saveGrow(Save *s, size_t extra)
+{
+	size_t cap = s->cap ? s->cap : 4096;
+	unsigned char *out;
+
+	if (s->failed)
+		return 0;
+	while (cap < s->len + extra)
+		cap *= 2;
+	if (cap != s->cap)
+	{
+		out = (unsigned char *)realloc(s->out, cap);
+		if (!out)
+		{
+			s->failed = 1;
+			return 0;
+		}
+		s->out = out;
+		s->cap = cap;
+	}
+	return 1;
+}
 
 static void put(Save *s, unsigned v)
 {
-	fputc(v, s->out);
-	s->crc = (s->crc >> 4) ^ crctable[(s->crc & 15) ^ (v & 15)];
-	s->crc = (s->crc >> 4) ^ crctable[(s->crc & 15) ^ (v >> 4)];
+	if (s->len < s->cap || saveGrow(s, 1))
+		s->out[s->len++] = (unsigned char)v;
 }
 
-static void updateAdler(Save *s, unsigned v)
+static void putBytes(Save *s, const void *data, size_t len)
 {
-	unsigned s1 = s->adler & 0xffff, s2 = (s->adler >> 16) & 0xffff;
-	s1 = (s1 +  v) % 65521;
-	s2 = (s2 + s1) % 65521;
-	s->adler = (s2 << 16) + s1;
+	if (saveGrow(s, len))
+	{
+		memcpy(s->out + s->len, data, len);
+		s->len += len;
+	}
 }
 
-static void put32(Save *s, unsigned v)
+static void initCrcTable(Save *s)
 {
-	put(s, (v >> 24) & 0xff);
-	put(s, (v >> 16) & 0xff);
-	put(s, (v >>  8) & 0xff);
-	put(s, v & 0xff);
+	unsigned n, k, c;
+
+	for (n=0;n<256;n++)
+	{
+		c = n;
+		for (k=0;k<8;k++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		s->crcTable[0][n] = c;
+	}
+	// Table k advances a byte that is followed by k more.
+	for (n=0;n<256;n++)
+		for (k=1;k<8;k++)
+			s->crcTable[k][n] = (s->crcTable[k-1][n] >> 8) ^ s->crcTable[0][s->crcTable[k-1][n] & 0xff];
+}
+
+// CRC-32 eight bytes at a time (slicing-by-8).
+static unsigned crc32(Save *s, unsigned crc, const unsigned char *p, size_t len)
+{
+	unsigned (*t)[256] = s->crcTable;
+	unsigned a, b;
+
+	crc = ~crc;
+	for (;len>=8;len-=8,p+=8)
+	{
+		a = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24));
+		b = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned)p[7] << 24);
+		crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^
+		      t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff] ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+	}
+	while (len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+	return ~crc;
 }
 
-void putbits(Save *s, unsigned data, unsigned bitcount)
+#ifdef TIGR_SSE2
+TIGR_INLINE unsigned saveSum32(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (unsigned)_mm_cvtsi128_si32(v);
+}
+#endif
+
+static unsigned adler32(unsigned adler, const unsigned char *data, size_t len)
 {
-	while (bitcount--)
+	unsigned s1 = adler & 0xffff, s2 = adler >> 16;
+	while (len > 0)
 	{
-		unsigned prev = s->bits;
-		s->bits = (s->bits >> 1) | ((data & 1) << 7);
-		data >>= 1;
-		if (prev & 1)
+		// 5552 bytes is the most that can be summed before s2 could overflow,
+		// so the modulo only happens once per run.
+		size_t n = len < 5552 ? len : 5552;
+		len -= n;
+
+#ifdef TIGR_SSE2
+		if (n >= 16)
+		{
+			// Per 16 bytes, s1 grows by their sum and s2 by 16 times the old
+			// s1 plus the bytes weighted 16 down to 1.
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i hiWeights = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+			const __m128i loWeights = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+			__m128i sums = zero, prefix = zero, weighted = zero;
+			size_t blocks = n / 16;
+
+			n -= blocks * 16;
+			s2 += s1 * (unsigned)(blocks * 16);
+			while (blocks--)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i *)data);
+				prefix = _mm_add_epi32(prefix, sums);
+				sums = _mm_add_epi32(sums, _mm_sad_epu8(v, zero));
+				weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), hiWeights));
+				weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), loWeights));
+				data += 16;
+			}
+			s2 += 16 * saveSum32(prefix) + saveSum32(weighted);
+			s1 += saveSum32(sums);
+		}
+#endif
+
+		while (n--)
 		{
-			put(s, s->bits);
-			s->bits = 0x80;
+			s1 += *data++;
+			s2 += s1;
 		}
+		s1 %= 65521;
+		s2 %= 65521;
 	}
+	return (s2 << 16) | s1;
 }
 
-void putbitsr(Save *s, unsigned data, unsigned bitcount)
+static void put32(Save *s, unsigned v)
 {
-	while (bitcount--)
-		putbits(s, data >> bitcount, 1);
+	put(s, (v >> 24) & 0xff);
+	put(s, (v >> 16) & 0xff);
+	put(s, (v >>  8) & 0xff);
+	put(s, v & 0xff);
 }
 
-static void begin(Save *s, const char *id, unsigned len)
+// Writes up to 16 bits, least significant first.
+static void putbits(Save *s, unsigned data, unsigned bitcount)
 {
-	put32(s, len);
-	s->crc = 0xffffffff;
-	put(s, id[0]); put(s, id[1]); put(s, id[2]); put(s, id[3]);
+	s->bits |= data << s->count;
+	s->count += bitcount;
+	while (s->count >= 8)
+	{
+		put(s, s->bits & 0xff);
+		s->bits >>= 8;
+		s->count -= 8;
+	}
 }
 
-static void literal(Save *s, unsigned v)
+static void flushbits(Save *s)
 {
-	// Encode a literal/length using the built-in tables.
-	// Could do better with a custom table but whatever.
-	     if (v < 144)   putbitsr(s, 0x030+v-  0, 8);
-	else if (v < 256)   putbitsr(s, 0x190+v-144, 9);
-	else if (v < 280)   putbitsr(s, 0x000+v-256, 7);
-	else                putbitsr(s, 0x0c0+v-280, 8);
+	if (s->count > 0)
+		put(s, s->bits & 0xff);
+	s->bits = 0;
+	s->count = 0;
 }
 
-static void encodelen(Save *s, unsigned code, unsigned bits, unsigned len)
+static void begin(Save *s, const char *id)
 {
-	literal(s, code + (len >> bits));
-	putbits(s, len, bits);
-	putbits(s, 0, 5);
+	s->chunk = s->len;
+	put32(s, 0);
+	putBytes(s, id, 4);
 }
 
-static void endrun(Save *s)
+// Fills in the length of the chunk that begin started and appends its CRC.
+static void end(Save *s)
 {
-	s->runlen--;
-	literal(s, s->prev);
+	size_t len;
+	unsigned char *p;
 
-	     if (s->runlen >= 67) encodelen(s, 277, 4, s->runlen - 67);
-	else if (s->runlen >= 35) encodelen(s, 273, 3, s->runlen - 35);
-	else if (s->runlen >= 19) encodelen(s, 269, 2, s->runlen - 19);
-	else if (s->runlen >= 11) encodelen(s, 265, 1, s->runlen - 11);
-	else if (s->runlen >=  3) encodelen(s, 257, 0, s->runlen -  3);
-	else while (s->runlen--) literal(s, s->prev);
+	if (s->failed)
+		return;
+	len = s->len - s->chunk - 8;
+	p = s->out + s->chunk;
+	p[0] = (unsigned char)(len >> 24);
+	p[1] = (unsigned char)(len >> 16);
+	p[2] = (unsigned char)(len >> 8);
+	p[3] = (unsigned char)len;
+	put32(s, crc32(s, 0, p + 4, len + 4));
 }
 
-static void encodeByte(Save *s, unsigned char v)
+static unsigned reverseBits(unsigned code, int len)
 {
-	updateAdler(s, v);
-
-	// Simple RLE compression. We could do better by doing a search
-	// to find matches, but this works pretty well TBH.
-	if (s->prev == v && s->runlen < 115)
+	unsigned r = 0;
+	while (len--)
 	{
-		s->runlen++;
-	} else {
-		if (s->runlen)
-			endrun(s);
-
-		s->prev = v;
-		s->runlen = 1;
+		r = (r << 1) | (code & 1);
+		code >>= 1;
 	}
+	return r;
 }
 
-static void savePngHeader(Save *s, Tigr *bmp)
+static void initSaveTables(Save *s)
 {
-	fwrite("\211PNG\r\n\032\n", 8, 1, s->out);
-	begin(s, "IHDR", 13);
-	put32(s, bmp->w);
-	put32(s, bmp->h);
-	put(s, 8); // bit depth
-	put(s, 6); // RGBA
-	put(s, 0); // compression (deflate)
-	put(s, 0); // filter (standard)
-	put(s, 0); // interlace off
-	put32(s, ~s->crc);
-}
+	int n, code, len;
 
-static long savePngData(Save *s, Tigr *bmp, long dataPos)
-{
-	int x, y;
-	long dataSize;
-	begin(s, "IDAT", 0);
-	put(s, 0x08); // zlib compression method
-	put(s, 0x1d); // zlib compression flags
-	putbits(s, 3, 3); // zlib last block + fixed dictionary
-	for (y=0;y<bmp->h;y++)
+	// Fixed Huffman codes, stored bit-reversed since deflate sends them MSB first.
+	for (n=0;n<288+32;n++)
 	{
-		TPixel *row = &bmp->pix[y*bmp->w];
-		TPixel prev = tigrRGBA(0, 0, 0, 0);
-
-		encodeByte(s, 1); // sub filter
-		for (x=0;x<bmp->w;x++)
+		     if (n <  144) { code = 0x030+n-  0; len = 8; }
+		else if (n <  256) { code = 0x190+n-144; len = 9; }
+		else if (n <  280) { code = 0x000+n-256; len = 7; }
+		else if (n <  288) { code = 0x0c0+n-280; len = 8; }
+		else               { code = n-288;       len = 5; }
+		s->fixedCodes[n] = (unsigned short)reverseBits(code, len);
+		s->fixedLens[n] = (unsigned char)len;
+	}
+	memset(s->lens, 0, sizeof(s->lens));
+
+	// Length and distance to symbol lookups. Distances past 256 are looked
+	// up by (dist-1) >> 7 in the upper half.
+	for (n=0;n<29;n++)
+		for (len=saveLenBase[n];len<saveLenBase[n]+(1<<saveLenBits[n]) && len<=SAVE_MAX_MATCH;len++)
+			s->lenSym[len] = (unsigned char)n;
+	for (n=0;n<30;n++)
+	{
+		for (code=saveDistBase[n]-1;code<saveDistBase[n]-1+(1<<saveDistBits[n]);code++)
 		{
-			encodeByte(s, row[x].r - prev.r);
-			encodeByte(s, row[x].g - prev.g);
-			encodeByte(s, row[x].b - prev.b);
-			encodeByte(s, row[x].a - prev.a);
-			prev = row[x];
+			if (code < 256)
+				s->distSym[code] = (unsigned char)n;
+			else
+				s->distSym[256 + (code >> 7)] = (unsigned char)n;
 		}
 	}
-	endrun(s);
-	literal(s, 256); // terminator
-	while (s->bits != 0x80)
-		putbits(s, 0, 1);
-	put32(s, s->adler);
-	dataSize = (ftell(s->out) - dataPos) - 8;
-	put32(s, ~s->crc);
-	return dataSize;
 }
 
-int tigrSaveImage(const char *fileName, Tigr *bmp)
-{
-	Save s;
-	long dataPos, dataSize, err;
-	
-	// TODO - unicode?
-	FILE *out = fopen(fileName, "wb");
-	if (!out)
-		return 1;
+// Tokens are recorded into the current block rather than written straight
+// away, so each block can get Huffman codes built from its own statistics.
+static void saveFlushBlock(Save *s, int count, int end, int last);
 
-	s.out = out;
-	s.adler = 1;
-	s.bits = 0x80;
-	s.prev = 0xffff;
-	s.runlen = 0;
+static void saveCheckSplit(Save *s);
 
-	savePngHeader(&s, bmp);
-	dataPos = ftell(s.out);
-	dataSize = savePngData(&s, bmp, dataPos);
+TIGR_INLINE void saveToken(Save *s, unsigned token, int lit, int dist, int bytes)
+{
+	s->tokens[s->tokenCount++] = token;
+	s->freq[lit]++;
+	s->splitFreq[lit]++;
+	if (dist >= 0)
+	{
+		s->freq[288+dist]++;
+		s->splitFreq[288+dist]++;
+	}
+	s->blockEnd += bytes;
 
-	// End chunk.
-	begin(&s, "IEND", 0);
-	put32(&s, ~s.crc);
+	if (s->tokenCount - s->splitToken == SAVE_SPLIT_TOKENS)
+		saveCheckSplit(s);
+	if (s->tokenCount == SAVE_BLOCK_TOKENS)
+		saveFlushBlock(s, s->tokenCount, s->blockEnd, 0);
+}
 
-	// Write back payload size.
-	fseek(out, dataPos, SEEK_SET);
-	put32(&s, dataSize);
+static void saveLiteral(Save *s, unsigned v)
+{
+	saveToken(s, v, v, -1, 1);
+}
 
-	err = ferror(out);
-	fclose(out);
-	return !err;
+static void saveMatch(Save *s, int len, int dist)
+{
+	int dsym = (dist <= 256) ? s->distSym[dist-1] : s->distSym[256 + ((dist-1) >> 7)];
+	saveToken(s, ((unsigned)dist << 9) | len, 257 + s->lenSym[len], dsym, len);
 }
 
-//////// End of inlined file: tigr_savepng.c ////////
+// log2(x) for x >= 1 in 16.16 fixed point. The fraction comes from squaring
+// the mantissa, so split decisions don't depend on libm or the FPU.
+static unsigned saveLog2(unsigned x)
+{
+	unsigned long long m;
+	unsigned r = 0;
+	int i;
 
-//////// Start of inlined file: tigr_utils.c ////////
+	while (x >> r > 1)
+		r++;
 
-//#include "tigr_internal.h"
-#include <stdio.h>
-#include <stdlib.h>
+	// x / 2^r in [1, 2), 2.30 fixed point.
+	m = ((unsigned long long)x << 30) >> r;
+	r <<= 16;
+	for (i=15;i>=0;i--)
+	{
+		m = (m * m) >> 30;
+		if (m >= (2ull << 30))
+		{
+			m >>= 1;
+			r |= 1u << i;
+		}
+	}
+	return r;
+}
 
-void *tigrReadFile(const char *fileName, int *length)
+// Bits needed to send the symbols with ideal codes for their frequencies,
+// in 1/65536ths of a bit.
+static long long saveEntropy(const unsigned *freq, int n)
 {
-	// TODO - unicode?
-	FILE *file;
-	char *data;
-	size_t len;
+	long long bits = 0, total = 0;
+	int i;
+	for (i=0;i<n;i++)
+	{
+		if (freq[i])
+		{
+			bits -= (long long)freq[i] * saveLog2(freq[i]);
+			total += freq[i];
+		}
+	}
+	return total > 0 ? bits + total * saveLog2((unsigned)total) : 0;
+}
 
-	if (length)
-		*length = 0;
+static long long saveCost(const unsigned *freq)
+{
+	return saveEntropy(freq, 288) + saveEntropy(freq + 288, 32);
+}
 
-	file = fopen(fileName, "rb");
-	if (!file)
-		return NULL;
+// Runs every SAVE_SPLIT_TOKENS tokens. If the tokens since the last check
+// are distributed differently enough from the rest of the block that a
+// second set of codes would pay for its header, the block ends before them.
+static void saveCheckSplit(Save *s)
+{
+	unsigned before[288+32];
+	int n;
 
-	fseek(file, 0, SEEK_END);
-	len = ftell(file);
-	fseek(file, 0, SEEK_SET);
+	if (s->splitToken > 0)
+	{
+		for (n=0;n<288+32;n++)
+			before[n] = s->freq[n] - s->splitFreq[n];
+		if (saveCost(s->freq) - saveCost(before) - saveCost(s->splitFreq) > (long long)SAVE_SPLIT_BITS << 16)
+			saveFlushBlock(s, s->splitToken, s->splitStart, 0);
+	}
 
-	data = (char *)malloc(len+1);
-	if (!data)
+	memset(s->splitFreq, 0, sizeof(s->splitFreq));
+	s->splitToken = s->tokenCount;
+	s->splitStart = s->blockEnd;
+}
+
+// Huffman code lengths for symbols sorted by increasing frequency, computed
+// in place (Moffat and Katajainen). A holds the frequencies on entry and
+// the lengths on return.
+static void saveMinRedundancy(int *A, int n)
+{
+	int root, leaf, next, avail, used, depth;
+
+	if (n == 1)
 	{
-		fclose(file);
-		return NULL;
+		A[0] = 1;
+		return;
 	}
 
-	if (fread(data, 1, len, file) != len) {
-		free(data);
-		fclose(file);
-		return NULL;
+	A[0] += A[1];
+	root = 0;
+	leaf = 2;
+	for (next=1;next<n-1;next++)
+	{
+		if (leaf >= n || A[root] < A[leaf]) { A[next] = A[root]; A[root++] = next; }
+		else A[next] = A[leaf++];
+		if (leaf >= n || (root < next && A[root] < A[leaf])) { A[next] += A[root]; A[root++] = next; }
+		else A[next] += A[leaf++];
 	}
-	data[len] = '\0';
-	fclose(file);
 
-	if (length)
-		*length = len;
+	A[n-2] = 0;
+	for (next=n-3;next>=0;next--)
+		A[next] = A[A[next]] + 1;
 
-	return data;
+	avail = 1;
+	used = depth = 0;
+	root = n-2;
+	next = n-1;
+	while (avail > 0)
+	{
+		while (root >= 0 && A[root] == depth) { used++; root--; }
+		while (avail > used) { A[next--] = depth; avail--; }
+		avail = 2*used;
+		depth++;
+		used = 0;
+	}
 }
 
-// Reads a single UTF8 codepoint.
-const char *tigrDecodeUTF8(const char *text, int *cp)
+static int saveCompareKeys(const void *a, const void *b)
 {
-	unsigned char c = *text++;
-	int extra = 0, min = 0;
-	*cp = 0;
-		 if (c >= 0xf0) { *cp = c & 0x07; extra = 3; min = 0x10000; }
-	else if (c >= 0xe0) { *cp = c & 0x0f; extra = 2; min = 0x800; }
-	else if (c >= 0xc0) { *cp = c & 0x1f; extra = 1; min = 0x80; }
-	else if (c >= 0x80) { *cp = 0xfffd; }
-	else *cp = c;
-	while (extra--) {
-		c = *text++;
-		if ((c & 0xc0) != 0x80) { *cp = 0xfffd; break; }
-		(*cp) = ((*cp) << 6) | (c & 0x3f);
-	}
-	if (*cp < min) *cp = 0xfffd;
-	return text;
+	unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+	return (x > y) - (x < y);
 }
 
-char *tigrEncodeUTF8(char *text, int cp)
+// Builds canonical codes of at most maxLen bits for n symbols, bit-reversed
+// for putbits. Unused symbols get length zero, but at least two symbols
+// always get a code so every decoder accepts the tree.
+static void saveBuildCodes(const unsigned *freq, int n, int maxLen, unsigned char *lens, unsigned short *codes)
 {
-	if (cp < 0 || cp > 0x10ffff) cp = 0xfffd;
+	unsigned keys[288];
+	int A[288], counts[16] = {0}, next[16];
+	int i, len, used = 0, total;
+
+	for (i=0;i<n;i++)
+		if (freq[i])
+			keys[used++] = (freq[i] << 9) | i;
+	for (i=0;used<2;i++)
+		if (!freq[i])
+			keys[used++] = (1u << 9) | i;
+	qsort(keys, used, sizeof(keys[0]), saveCompareKeys);
+
+	for (i=0;i<used;i++)
+		A[i] = keys[i] >> 9;
+	saveMinRedundancy(A, used);
+
+	// Fold anything past maxLen back into the limit, then lengthen the
+	// deepest shorter codes until the lengths form a complete code again.
+	for (i=0;i<used;i++)
+		counts[A[i] < maxLen ? A[i] : maxLen]++;
+	total = 0;
+	for (len=1;len<=maxLen;len++)
+		total += counts[len] << (maxLen - len);
+	while (total > (1 << maxLen))
+	{
+		counts[maxLen]--;
+		for (len=maxLen-1;len>0;len--)
+		{
+			if (counts[len])
+			{
+				counts[len]--;
+				counts[len+1] += 2;
+				break;
+			}
+		}
+		total--;
+	}
 
-#define EMIT(X,Y,Z) *text++ = X | ((cp >> Y)&Z)
-		 if (cp <     0x80) { EMIT(0x00,0,0x7f); }
-	else if (cp <    0x800) { EMIT(0xc0,6,0x1f); EMIT(0x80, 0, 0x3f); }
-	else if (cp <  0x10000) { EMIT(0xe0,12,0xf); EMIT(0x80, 6, 0x3f); EMIT(0x80, 0, 0x3f); }
-	else                    { EMIT(0xf0,18,0x7); EMIT(0x80, 12, 0x3f); EMIT(0x80, 6, 0x3f); EMIT(0x80, 0, 0x3f); }
-	return text;
-#undef EMIT
+	// Shortest lengths to the most frequent symbols.
+	memset(lens, 0, n);
+	for (len=1,i=used;len<=maxLen;len++)
+		while (counts[len]-- > 0)
+			lens[keys[--i] & 511] = (unsigned char)len;
+
+	memset(counts, 0, sizeof(counts));
+	for (i=0;i<n;i++)
+		counts[lens[i]]++;
+	counts[0] = 0;
+	next[1] = 0;
+	for (len=2;len<=maxLen;len++)
+		next[len] = (next[len-1] + counts[len-1]) << 1;
+	for (i=0;i<n;i++)
+		codes[i] = lens[i] ? (unsigned short)reverseBits(next[lens[i]]++, lens[i]) : 0;
 }
 
-void tigrSetPostFX(Tigr *bmp, int hblur, int vblur, float scanlines, float contrast)
+// Run-length codes for the code lengths in a dynamic block header, each as
+// symbol | (extra bits << 5).
+static int saveHeaderRuns(const unsigned char *lens, int n, unsigned short *runs)
 {
-	TigrInternal *win = tigrInternal(bmp);
-	win->hblur = hblur;
-	win->vblur = vblur;
-	win->scanlines = scanlines;
-	win->contrast = contrast;
-}
-
-//////// End of inlined file: tigr_utils.c ////////
+	int i = 0, count = 0, run;
 
-//////// Start of inlined file: tigr_inflate.c ////////
+	while (i < n)
+	{
+		unsigned v = lens[i];
+		for (run=1;i+run<n && lens[i+run]==v;run++) {}
+		i += run;
 
-//#include "tigr_internal.h"
-#include <stdlib.h>
-#include <setjmp.h>
+		if (v == 0)
+		{
+			while (run >= 11) { int r = run < 138 ? run : 138; runs[count++] = (unsigned short)(18 | ((r-11) << 5)); run -= r; }
+			if (run >= 3)     { runs[count++] = (unsigned short)(17 | ((run-3) << 5)); run = 0; }
+		} else {
+			runs[count++] = (unsigned short)v;
+			run--;
+			while (run >= 3)  { int r = run < 6 ? run : 6; runs[count++] = (unsigned short)(16 | ((r-3) << 5)); run -= r; }
+		}
+		while (run-- > 0)
+			runs[count++] = (unsigned short)v;
+	}
+	return count;
+}
 
-typedef struct {
-	unsigned bits, count;
-	const unsigned char *in, *inend;
-	unsigned char *out, *outend;
-	jmp_buf jmp;
-	unsigned litcodes[288], distcodes[32], lencodes[19];
-	int tlit, tdist, tlen;
-} State;
+static void saveWriteTokens(Save *s, const unsigned short *codes, const unsigned char *lens, int count)
+{
+	int i, len, dist, sym;
 
-#define FAIL() longjmp(s->jmp, 1)
-#define CHECK(X) if (!(X)) FAIL()
+	for (i=0;i<count;i++)
+	{
+		unsigned t = s->tokens[i];
+		if (t < 512)
+		{
+			putbits(s, codes[t], lens[t]);
+			continue;
+		}
 
-// Built-in DEFLATE standard tables.
-static char order[] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
-static char lenBits[29+2] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0,  0,0 };
-static int lenBase[29+2] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258,  0,0 };
-static char distBits[30+2] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13,  0,0 };
-static int distBase[30+2] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+		len = t & 511;
+		dist = t >> 9;
+		sym = s->lenSym[len];
+		putbits(s, codes[257+sym], lens[257+sym]);
+		putbits(s, len - saveLenBase[sym], saveLenBits[sym]);
 
-// Table to bit-reverse a byte.
-static const unsigned char reverseTable[256] = {
-#define R2(n)    n,     n + 128,     n + 64,     n + 192
-#define R4(n) R2(n), R2(n +  32), R2(n + 16), R2(n +  48)
-#define R6(n) R4(n), R4(n +   8), R4(n +  4), R4(n +  12)
-	R6(0), R6(2), R6(1), R6(3)
-};
+		sym = (dist <= 256) ? s->distSym[dist-1] : s->distSym[256 + ((dist-1) >> 7)];
+		putbits(s, codes[288+sym], lens[288+sym]);
+		putbits(s, dist - saveDistBase[sym], saveDistBits[sym]);
+	}
+	putbits(s, codes[256], lens[256]);
+}
 
-static unsigned rev16(unsigned n) { return (reverseTable[n&0xff] << 8) | reverseTable[(n>>8)&0xff]; }
+static void saveStored(Save *s, const unsigned char *data, int size, int last);
 
-static int bits(State *s, int n)
+// Writes the first count tokens, covering the input up to end, as one
+// block: dynamic, fixed or stored, whichever is smallest.
+static void saveFlushBlock(Save *s, int count, int end, int last)
 {
-	int v = s->bits & ((1 << n)-1);
-	s->bits >>= n;
-	s->count -= n;
-	while (s->count < 16)
+	static const unsigned char order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+	static const unsigned char runBits[3] = { 2, 3, 7 };
+	unsigned freq[288+32], runFreq[19] = {0};
+	unsigned char lens[286+30], runLens[19];
+	unsigned short runs[286+30], runCodes[19];
+	long long extra = 0, dynamicBits, fixedBits, storedBits;
+	int i, nlit, ndist, nruns, ncodes, rawSize = end - s->blockStart;
+
+	// The counts for just these tokens.
+	for (i=0;i<288+32;i++)
+		freq[i] = s->freq[i] - (count < s->tokenCount ? s->splitFreq[i] : 0);
+	freq[256] = 1;
+
+	saveBuildCodes(freq, 286, 15, s->lens, s->codes);
+	saveBuildCodes(freq+288, 30, 15, s->lens+288, s->codes+288);
+
+	for (nlit=286;nlit>257 && !s->lens[nlit-1];nlit--) {}
+	for (ndist=30;ndist>1 && !s->lens[288+ndist-1];ndist--) {}
+	memcpy(lens, s->lens, nlit);
+	memcpy(lens+nlit, s->lens+288, ndist);
+	nruns = saveHeaderRuns(lens, nlit+ndist, runs);
+	for (i=0;i<nruns;i++)
+		runFreq[runs[i] & 31]++;
+	saveBuildCodes(runFreq, 19, 7, runLens, runCodes);
+	for (ncodes=19;ncodes>4 && !runLens[order[ncodes-1]];ncodes--) {}
+
+	for (i=0;i<29;i++)
+		extra += (long long)freq[257+i] * saveLenBits[i];
+	for (i=0;i<30;i++)
+		extra += (long long)freq[288+i] * saveDistBits[i];
+
+	dynamicBits = 3 + 5+5+4 + 3*ncodes + extra;
+	for (i=0;i<nruns;i++)
+		dynamicBits += runLens[runs[i] & 31] + ((runs[i] & 31) >= 16 ? runBits[(runs[i] & 31) - 16] : 0);
+	fixedBits = 3 + extra;
+	for (i=0;i<288+32;i++)
 	{
-		CHECK(s->in != s->inend);
-		s->bits |= (*s->in++) << s->count;
-		s->count += 8;
+		dynamicBits += (long long)freq[i] * s->lens[i];
+		fixedBits += (long long)freq[i] * s->fixedLens[i];
 	}
-	return v;
+	storedBits = ((long long)rawSize + 5 * (rawSize / 65535 + 1)) * 8 + 7;
+
+	if (storedBits < dynamicBits && storedBits < fixedBits)
+	{
+		saveStored(s, s->data + s->blockStart, rawSize, last);
+	} else if (fixedBits <= dynamicBits) {
+		putbits(s, last | (1 << 1), 3);
+		saveWriteTokens(s, s->fixedCodes, s->fixedLens, count);
+	} else {
+		putbits(s, last | (2 << 1), 3);
+		putbits(s, nlit - 257, 5);
+		putbits(s, ndist - 1, 5);
+		putbits(s, ncodes - 4, 4);
+		for (i=0;i<ncodes;i++)
+			putbits(s, runLens[order[i]], 3);
+		for (i=0;i<nruns;i++)
+		{
+			int sym = runs[i] & 31;
+			putbits(s, runCodes[sym], runLens[sym]);
+			if (sym >= 16)
+				putbits(s, runs[i] >> 5, runBits[sym - 16]);
+		}
+		saveWriteTokens(s, s->codes, s->lens, count);
+	}
+
+	// Whatever is left starts the next block.
+	for (i=0;i<288+32;i++)
+		s->freq[i] -= freq[i];
+	s->freq[256] = 0;
+	memmove(s->tokens, s->tokens + count, (s->tokenCount - count) * sizeof(s->tokens[0]));
+	s->tokenCount -= count;
+	s->splitToken -= count;
+	if (s->splitToken < 0)
+	{
+		s->splitToken = 0;
+		s->splitStart = end;
+		memset(s->splitFreq, 0, sizeof(s->splitFreq));
+	}
+	s->blockStart = end;
 }
 
-static unsigned char *emit(State *s, int len)
+// Hash chains over the input: head holds the latest position for each
+// hash of the next 3 bytes, prev links each position in the window to the
+// one before it with the same hash. Only [start, size) is compressed, but
+// matches can reach back before start.
+typedef struct {
+	const unsigned char *data;
+	int start, size;
+	int *head, *prev;
+	SaveLevel level;
+} SaveMatcher;
+
+TIGR_INLINE void saveInsert(SaveMatcher *m, int pos)
 {
-	s->out += len;
-	CHECK(s->out <= s->outend);
-	return s->out-len;
+	const unsigned char *p = m->data + pos;
+	unsigned h = ((p[0] | (p[1] << 8) | (p[2] << 16)) * 2654435761u) >> (32 - SAVE_HASH_BITS);
+	m->prev[pos & (SAVE_WINDOW-1)] = m->head[h];
+	m->head[h] = pos;
 }
 
-static void copy(State *s, const unsigned char *src, int len)
+TIGR_INLINE int saveMatchLength(const unsigned char *a, const unsigned char *b, int max)
 {
-	unsigned char *dest = emit(s, len);
-	while (len--) *dest++ = *src++;
+	int n = 0;
+	while (n + 8 <= max)
+	{
+		unsigned long long x, y;
+		memcpy(&x, a+n, 8);
+		memcpy(&y, b+n, 8);
+		if (x != y)
+			break;
+		n += 8;
+	}
+	while (n < max && a[n] == b[n])
+		n++;
+	return n;
 }
 
-static int build(State *s, unsigned *tree, unsigned char *lens, int symcount)
+// Looks down the chain of the (already inserted) position pos for a match
+// longer than best. Returns its length, or zero if there wasn't one.
+static int saveFindMatch(SaveMatcher *m, int pos, int best, int *dist)
 {
-	int n, codes[16], first[16], counts[16]={0};
+	const unsigned char *cur = m->data + pos;
+	int maxLen = m->size - pos < SAVE_MAX_MATCH ? m->size - pos : SAVE_MAX_MATCH;
+	int nice = m->level.nice < maxLen ? m->level.nice : maxLen;
+	int chain = m->level.chain;
+	// Keeping the distance under the window size means a slot in prev is
+	// never overwritten while something in range still points at it.
+	int limit = pos - SAVE_WINDOW;
+	int cand = m->prev[pos & (SAVE_WINDOW-1)];
+	int found = 0;
+
+	if (best >= maxLen)
+		return 0;
+	if (best >= m->level.good)
+		chain >>= 2;
 
-	// Frequency count.
-	for (n=0;n<symcount;n++) counts[lens[n]]++;
+	while (cand > limit && chain-- > 0)
+	{
+		const unsigned char *p = m->data + cand;
+		if (p[best] == cur[best] && p[best-1] == cur[best-1] && p[0] == cur[0] && p[1] == cur[1])
+		{
+			int len = saveMatchLength(p, cur, maxLen);
+			if (len > best)
+			{
+				best = found = len;
+				*dist = pos - cand;
+				if (len >= nice)
+					break;
+			}
+		}
+		cand = m->prev[cand & (SAVE_WINDOW-1)];
+	}
+	return found;
+}
 
-	// Distribute codes.
-	counts[0] = codes[0] = first[0] = 0;
+static void saveGreedy(Save *s, SaveMatcher *m)
+{
+	int pos = m->start, len, dist, end;
+
+	while (pos < m->size)
+	{
+		len = 0;
+		if (pos + SAVE_MIN_MATCH <= m->size)
+		{
+			saveInsert(m, pos);
+			len = saveFindMatch(m, pos, SAVE_MIN_MATCH-1, &dist);
+		}
+
+		if (len >= SAVE_MIN_MATCH)
+		{
+			saveMatch(s, len, dist);
+			end = pos + len;
+			if (len <= m->level.lazy)
+			{
+				for (pos++;pos<end && pos+SAVE_MIN_MATCH<=m->size;pos++)
+					saveInsert(m, pos);
+			}
+			pos = end;
+		} else {
+			saveLiteral(s, m->data[pos++]);
+		}
+	}
+}
+
+static void saveLazy(Save *s, SaveMatcher *m)
+{
+	// A match found at pos-1 is only taken if pos doesn't have a longer one.
+	int pos = m->start, len, dist = 0, prevLen = 0, prevDist = 0, pending = 0, end;
+
+	while (pos < m->size)
+	{
+		len = 0;
+		if (pos + SAVE_MIN_MATCH <= m->size)
+		{
+			saveInsert(m, pos);
+			if (prevLen < m->level.lazy)
+				len = saveFindMatch(m, pos, prevLen >= SAVE_MIN_MATCH ? prevLen : SAVE_MIN_MATCH-1, &dist);
+		}
+
+		if (prevLen >= SAVE_MIN_MATCH && len <= prevLen)
+		{
+			saveMatch(s, prevLen, prevDist);
+			end = pos - 1 + prevLen;
+			for (pos++;pos<end && pos+SAVE_MIN_MATCH<=m->size;pos++)
+				saveInsert(m, pos);
+			pos = end;
+			prevLen = 0;
+			pending = 0;
+		} else {
+			if (pending)
+				saveLiteral(s, m->data[pos-1]);
+			pending = 1;
+			prevLen = len;
+			prevDist = dist;
+			pos++;
+		}
+	}
+	if (pending)
+		saveLiteral(s, m->data[pos-1]);
+}
+
+// Compresses data[start, end) as a run of blocks. The window is primed
+// with the 32K before start. Unless it is the last, the run ends with a
+// sync flush (an empty stored block) so the next one starts on a byte.
+static int saveCompressed(Save *s, const unsigned char *data, int start, int end, int level, int last)
+{
+	SaveMatcher m;
+	int n;
+
+	m.data = data;
+	m.start = start;
+	m.size = end;
+	m.level = saveLevels[level];
+	m.head = (int *)malloc(sizeof(int) << SAVE_HASH_BITS);
+	m.prev = (int *)malloc(sizeof(int) * SAVE_WINDOW);
+	s->tokens = (unsigned *)malloc(sizeof(unsigned) * SAVE_BLOCK_TOKENS);
+	if (!m.head || !m.prev || !s->tokens)
+	{
+		free(m.head);
+		free(m.prev);
+		free(s->tokens);
+		return 0;
+	}
+	for (n=0;n<1<<SAVE_HASH_BITS;n++)
+		m.head[n] = -SAVE_WINDOW-1;
+	for (n=start>SAVE_WINDOW ? start-SAVE_WINDOW : 0;n<start && n+SAVE_MIN_MATCH<=end;n++)
+		saveInsert(&m, n);
+
+	s->data = data;
+	s->tokenCount = s->splitToken = 0;
+	s->blockStart = s->blockEnd = s->splitStart = start;
+	memset(s->freq, 0, sizeof(s->freq));
+	memset(s->splitFreq, 0, sizeof(s->splitFreq));
+
+	if (level <= 3)
+		saveGreedy(s, &m);
+	else
+		saveLazy(s, &m);
+	saveFlushBlock(s, s->tokenCount, s->blockEnd, last);
+	if (!last)
+		saveStored(s, NULL, 0, 0);
+	flushbits(s);
+
+	free(m.head);
+	free(m.prev);
+	free(s->tokens);
+	return 1;
+}
+
+static void saveStored(Save *s, const unsigned char *data, int size, int last)
+{
+	int len;
+	do {
+		len = size < 65535 ? size : 65535;
+		size -= len;
+		putbits(s, last && size == 0, 3); // last block flag + stored
+		flushbits(s);
+		put(s, len & 0xff); put(s, len >> 8);
+		put(s, ~len & 0xff); put(s, (~len >> 8) & 0xff);
+		if (len > 0)
+			putBytes(s, data, len);
+		data += len;
+	} while (size > 0);
+}
+
+static void savePngHeader(Save *s, int w, int h)
+{
+	putBytes(s, "\211PNG\r\n\032\n", 8);
+	begin(s, "IHDR");
+	put32(s, w);
+	put32(s, h);
+	put(s, 8); // bit depth
+	put(s, 6); // RGBA
+	put(s, 0); // compression (deflate)
+	put(s, 0); // filter (standard)
+	put(s, 0); // interlace off
+	end(s);
+}
+
+// PNG scanline filters over RGBA bytes, four per pixel. a is the byte one
+// pixel to the left, b the one above and c the one above-left. Rows are
+// padded so that cur[-4..-1] and prev[-4..-1] read as zero.
+enum { SAVE_NONE, SAVE_SUB, SAVE_UP, SAVE_AVERAGE, SAVE_PAETH, SAVE_FILTERS };
+
+TIGR_INLINE int savePaeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+#ifdef TIGR_SSE2
+TIGR_INLINE __m128i saveLessEqual(__m128i x, __m128i y)
+{
+	return _mm_cmpeq_epi8(_mm_min_epu8(x, y), x);
+}
+
+// Paeth predictor for 16 bytes, without widening. pa = |b-c| and pb = |a-c|
+// fit in a byte. pc = |(b-c) + (a-c)| is pa+pb when both differences have
+// the same sign, which can saturate since it is then never the smallest,
+// and |pa-pb| when they don't.
+TIGR_INLINE __m128i savePaeth16(__m128i a, __m128i b, __m128i c)
+{
+	__m128i pa = _mm_sub_epi8(_mm_max_epu8(b, c), _mm_min_epu8(b, c));
+	__m128i pb = _mm_sub_epi8(_mm_max_epu8(a, c), _mm_min_epu8(a, c));
+	__m128i same = _mm_cmpeq_epi8(saveLessEqual(c, b), saveLessEqual(c, a));
+	__m128i pc = _mm_or_si128(_mm_and_si128(same, _mm_adds_epu8(pa, pb)),
+		_mm_andnot_si128(same, _mm_sub_epi8(_mm_max_epu8(pa, pb), _mm_min_epu8(pa, pb))));
+	__m128i useA = _mm_and_si128(saveLessEqual(pa, pb), saveLessEqual(pa, pc));
+	__m128i useB = _mm_andnot_si128(useA, saveLessEqual(pb, pc));
+	__m128i useC = _mm_andnot_si128(_mm_or_si128(useA, useB), c);
+	return _mm_or_si128(_mm_or_si128(_mm_and_si128(useA, a), _mm_and_si128(useB, b)), useC);
+}
+#endif
+
+static void saveFilterRow(int type, unsigned char *out, const unsigned char *cur, const unsigned char *prev, int len)
+{
+	int x = 0;
+
+#ifdef TIGR_SSE2
+	const __m128i one = _mm_set1_epi8(1);
+	for (;x+16<=len;x+=16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(cur + x));
+		__m128i a = _mm_loadu_si128((const __m128i *)(cur + x - 4));
+		__m128i b = _mm_loadu_si128((const __m128i *)(prev + x));
+		__m128i c = _mm_loadu_si128((const __m128i *)(prev + x - 4));
+		switch (type)
+		{
+		case SAVE_NONE:
+			break;
+		case SAVE_SUB:
+			v = _mm_sub_epi8(v, a);
+			break;
+		case SAVE_UP:
+			v = _mm_sub_epi8(v, b);
+			break;
+		case SAVE_AVERAGE:
+			// pavgb rounds up, take the carry back off for odd sums.
+			v = _mm_sub_epi8(v, _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)));
+			break;
+		case SAVE_PAETH:
+			v = _mm_sub_epi8(v, savePaeth16(a, b, c));
+			break;
+		}
+		_mm_storeu_si128((__m128i *)(out + x), v);
+	}
+#endif
+
+	for (;x<len;x++)
+	{
+		int a = cur[x-4], b = prev[x], c = prev[x-4];
+		switch (type)
+		{
+		case SAVE_NONE:    out[x] = cur[x]; break;
+		case SAVE_SUB:     out[x] = (unsigned char)(cur[x] - a); break;
+		case SAVE_UP:      out[x] = (unsigned char)(cur[x] - b); break;
+		case SAVE_AVERAGE: out[x] = (unsigned char)(cur[x] - ((a + b) >> 1)); break;
+		case SAVE_PAETH:   out[x] = (unsigned char)(cur[x] - savePaeth(a, b, c)); break;
+		}
+	}
+}
+
+TIGR_INLINE unsigned saveByteCost(int v)
+{
+	v &= 0xff;
+	return v < 128 ? v : 256 - v;
+}
+
+// Sums each filter's output bytes taken as signed, the usual guess at which
+// filter will compress best, in one pass without storing any of them.
+static void saveRowCosts(const unsigned char *cur, const unsigned char *prev, int len, int filters, unsigned *costs)
+{
+	int x = 0, type;
+
+	for (type=0;type<SAVE_FILTERS;type++)
+		costs[type] = 0;
+
+#ifdef TIGR_SSE2
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi8(1);
+		__m128i sums[SAVE_FILTERS];
+		for (type=0;type<SAVE_FILTERS;type++)
+			sums[type] = zero;
+
+#define SAVE_COST(T, F) f = (F); sums[T] = _mm_add_epi64(sums[T], _mm_sad_epu8(_mm_min_epu8(f, _mm_sub_epi8(zero, f)), zero))
+		for (;x+16<=len;x+=16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)(cur + x));
+			__m128i a = _mm_loadu_si128((const __m128i *)(cur + x - 4));
+			__m128i b = _mm_loadu_si128((const __m128i *)(prev + x));
+			__m128i c = _mm_loadu_si128((const __m128i *)(prev + x - 4));
+			__m128i f;
+			SAVE_COST(SAVE_NONE, v);
+			SAVE_COST(SAVE_SUB, _mm_sub_epi8(v, a));
+			if (filters > SAVE_UP)
+			{
+				SAVE_COST(SAVE_UP, _mm_sub_epi8(v, b));
+				SAVE_COST(SAVE_AVERAGE, _mm_sub_epi8(v, _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one))));
+				SAVE_COST(SAVE_PAETH, _mm_sub_epi8(v, savePaeth16(a, b, c)));
+			}
+		}
+#undef SAVE_COST
+
+		for (type=0;type<SAVE_FILTERS;type++)
+			costs[type] = (unsigned)_mm_cvtsi128_si32(sums[type]) + (unsigned)_mm_cvtsi128_si32(_mm_unpackhi_epi64(sums[type], sums[type]));
+	}
+#endif
+
+	for (;x<len;x++)
+	{
+		int v = cur[x], a = cur[x-4], b = prev[x], c = prev[x-4];
+		costs[SAVE_NONE] += saveByteCost(v);
+		costs[SAVE_SUB] += saveByteCost(v - a);
+		if (filters > SAVE_UP)
+		{
+			costs[SAVE_UP] += saveByteCost(v - b);
+			costs[SAVE_AVERAGE] += saveByteCost(v - ((a + b) >> 1));
+			costs[SAVE_PAETH] += saveByteCost(v - savePaeth(a, b, c));
+		}
+	}
+}
+
+// Copies a row of pixels out as RGBA bytes.
+static void saveRowBytes(unsigned char *out, const TPixel *row, int w)
+{
+	int x = 0;
+
+#ifdef TIGR_SSE2
+	// Swap the b and r bytes of each pixel.
+	const __m128i ga = _mm_set1_epi32((int)0xff00ff00);
+	const __m128i low = _mm_set1_epi32(0xff);
+	for (;x+4<=w;x+=4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i *)(row + x));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+		__m128i b = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+		_mm_storeu_si128((__m128i *)(out + x*4), _mm_or_si128(_mm_and_si128(p, ga), _mm_or_si128(r, b)));
+	}
+#endif
+
+	for (;x<w;x++)
+	{
+		out[x*4+0] = row[x].r;
+		out[x*4+1] = row[x].g;
+		out[x*4+2] = row[x].b;
+		out[x*4+3] = row[x].a;
+	}
+}
+
+// Filters rows [y0, y1) into PNG scanlines, each starting with its filter
+// type. Every row gets whichever of the five filters has the lowest cost.
+static unsigned char *saveFilter(Tigr *bmp, int y0, int y1, int *size)
+{
+	int y, type, best, filters, len = bmp->w*4;
+	int pitch = (len + 16 + 15) & ~15;
+	unsigned costs[SAVE_FILTERS];
+	unsigned char *data, *out, *scratch, *cur, *prev, *swap;
+
+	*size = (y1 - y0) * (1 + len);
+	data = out = (unsigned char *)malloc(*size > 0 ? *size : 1);
+	scratch = (unsigned char *)calloc(2, pitch);
+	if (!data || !scratch)
+	{
+		free(data);
+		free(scratch);
+		return NULL;
+	}
+
+	// Two source rows, each with four zero bytes in front.
+	prev = scratch + 16;
+	cur = prev + pitch;
+	if (y0 > 0)
+		saveRowBytes(prev, &bmp->pix[(y0-1)*bmp->stride], bmp->w);
+
+	for (y=y0;y<y1;y++)
+	{
+		saveRowBytes(cur, &bmp->pix[y*bmp->stride], bmp->w);
+
+		// The first row has nothing above, where Up and Paeth are the same
+		// as None and Sub.
+		filters = y > 0 ? SAVE_FILTERS : SAVE_UP;
+		saveRowCosts(cur, prev, len, filters, costs);
+		best = SAVE_NONE;
+		for (type=1;type<filters;type++)
+			if (costs[type] < costs[best])
+				best = type;
+
+		*out++ = (unsigned char)best;
+		saveFilterRow(best, out, cur, prev, len);
+		out += len;
+
+		swap = prev;
+		prev = cur;
+		cur = swap;
+	}
+
+	free(scratch);
+	return data;
+}
+
+// Adler-32 of two pieces put together, from the checksum of each and the
+// length of the second.
+static unsigned adler32Combine(unsigned adler1, unsigned adler2, size_t len2)
+{
+	unsigned rem = (unsigned)(len2 % 65521);
+	unsigned s1 = adler1 & 0xffff;
+	unsigned s2 = (rem * s1) % 65521;
+
+	s1 += (adler2 & 0xffff) + 65521 - 1;
+	s2 += (adler1 >> 16) + (adler2 >> 16) + 65521 - rem;
+	if (s1 >= 65521) s1 -= 65521;
+	if (s1 >= 65521) s1 -= 65521;
+	if (s2 >= 65521*2) s2 -= 65521*2;
+	if (s2 >= 65521) s2 -= 65521;
+	return (s2 << 16) | s1;
+}
+
+typedef struct {
+	int y0, y1;      // rows
+	Save *save;      // their compressed blocks
+	unsigned adler;  // of their filtered bytes
+	int size;
+} SaveSegment;
+
+struct TigrSaveJob {
+	Tigr *bmp;
+	int level;
+	int segmentCount;
+	SaveSegment *segments;
+};
+
+TigrSaveJob *tigrSaveBegin(Tigr *bmp, const TigrSaveOptions *options, int segments)
+{
+	TigrSaveJob *job;
+	int n, rows;
+
+	job = (TigrSaveJob *)calloc(1, sizeof(TigrSaveJob));
+	if (!job)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	job->bmp = bmp;
+	job->level = options ? options->level : SAVE_DEFAULT_LEVEL;
+	if (job->level < 0) job->level = 0;
+	if (job->level > 9) job->level = 9;
+
+	// Segments are whole groups of scanlines.
+	rows = bmp->h > 0 ? bmp->h : 1;
+	if (segments > rows) segments = rows;
+	if (segments < 1) segments = 1;
+
+	job->segments = (SaveSegment *)calloc(segments, sizeof(SaveSegment));
+	if (!job->segments)
+	{
+		free(job);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	job->segmentCount = segments;
+	for (n=0;n<segments;n++)
+	{
+		job->segments[n].y0 = (int)((long long)bmp->h * n / segments);
+		job->segments[n].y1 = (int)((long long)bmp->h * (n+1) / segments);
+	}
+	return job;
+}
+
+int tigrSaveSegments(TigrSaveJob *job)
+{
+	return job->segmentCount;
+}
+
+void tigrSaveSegment(TigrSaveJob *job, int index)
+{
+	SaveSegment *seg = &job->segments[index];
+	Tigr *bmp = job->bmp;
+	int last = index == job->segmentCount-1;
+	int rowBytes = 1 + bmp->w*4;
+	// Each segment filters its own copy of the window's worth of rows
+	// before it, so segments share nothing while they run.
+	int y = seg->y0 - (SAVE_WINDOW + rowBytes - 1) / rowBytes;
+	int start, size;
+	unsigned char *data;
+	Save *s;
+
+	if (y < 0)
+		y = 0;
+	if (job->level == 0)
+		y = seg->y0; // stored blocks don't look back
+	start = (seg->y0 - y) * rowBytes;
+
+	s = (Save *)calloc(1, sizeof(Save));
+	data = saveFilter(bmp, y, seg->y1, &size);
+	if (!s || !data)
+	{
+		free(s);
+		free(data);
+		return;
+	}
+
+	initSaveTables(s);
+	// Most frames compress well, start with room for a quarter.
+	saveGrow(s, (size - start) / 4 + 1024);
+
+	if (job->level == 0)
+		saveStored(s, data + start, size - start, last);
+	else if (!saveCompressed(s, data, start, size, job->level, last))
+		s->failed = 1;
+	seg->adler = adler32(1, data + start, size - start);
+	seg->size = size - start;
+	seg->save = s;
+	free(data);
+}
+
+void *tigrSaveEnd(TigrSaveJob *job, int *length)
+{
+	// zlib header: deflate with a 32K window, FLEVEL roughly matching level.
+	static const unsigned char flags[10] = { 0x01, 0x01, 0x5e, 0x5e, 0x5e, 0x5e, 0x9c, 0xda, 0xda, 0xda };
+	Save *s = NULL;
+	void *out = NULL;
+	unsigned adler = 1;
+	size_t total = 0;
+	int n, failed = 0;
+
+	if (length)
+		*length = 0;
+
+	for (n=0;n<job->segmentCount;n++)
+	{
+		Save *seg = job->segments[n].save;
+		failed |= !seg || seg->failed;
+		total += seg ? seg->len : 0;
+	}
+
+	if (!failed)
+		s = (Save *)calloc(1, sizeof(Save));
+	if (s)
+	{
+		initCrcTable(s);
+		saveGrow(s, total + 1024);
+		savePngHeader(s, job->bmp->w, job->bmp->h);
+
+		// The segments already end on byte boundaries, so they just follow
+		// each other in one zlib stream.
+		begin(s, "IDAT");
+		put(s, 0x78);
+		put(s, flags[job->level]);
+		for (n=0;n<job->segmentCount;n++)
+		{
+			SaveSegment *seg = &job->segments[n];
+			putBytes(s, seg->save->out, seg->save->len);
+			adler = adler32Combine(adler, seg->adler, seg->size);
+		}
+		put32(s, adler);
+		end(s);
+
+		begin(s, "IEND");
+		end(s);
+
+		if (!s->failed)
+		{
+			out = s->out;
+			if (length)
+				*length = (int)s->len;
+		} else {
+			free(s->out);
+		}
+		free(s);
+	}
+	if (!out)
+		errno = ENOMEM;
+
+	for (n=0;n<job->segmentCount;n++)
+	{
+		if (job->segments[n].save)
+		{
+			free(job->segments[n].save->out);
+			free(job->segments[n].save);
+		}
+	}
+	free(job->segments);
+	free(job);
+	return out;
+}
+
+void *tigrSaveImageMem(Tigr *bmp, const TigrSaveOptions *options, int *length)
+{
+	TigrSaveJob *job = tigrSaveBegin(bmp, options, 1);
+	if (!job)
+	{
+		if (length)
+			*length = 0;
+		return NULL;
+	}
+	tigrSaveSegment(job, 0);
+	return tigrSaveEnd(job, length);
+}
+
+int tigrSaveImageEx(const char *fileName, Tigr *bmp, const TigrSaveOptions *options)
+{
+	int len, ok;
+	FILE *out;
+	void *data = tigrSaveImageMem(bmp, options, &len);
+	if (!data)
+		return 0;
+
+	// TODO - unicode?
+	out = fopen(fileName, "wb");
+	if (!out)
+	{
+		free(data);
+		return 0;
+	}
+
+	ok = fwrite(data, 1, len, out) == (size_t)len;
+	ok = (fclose(out) == 0) && ok;
+	free(data);
+	return ok;
+}
+
+int tigrSaveImage(const char *fileName, Tigr *bmp)
+{
+	return tigrSaveImageEx(fileName, bmp, NULL);
+}
+
+//////// End of inlined file: tigr_savepng.c ////////
+
+//////// Start of inlined file: tigr_utils.c ////////
+
+//#include "tigr_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void *tigrReadFile(const char *fileName, int *length)
+{
+	// TODO - unicode?
+	FILE *file;
+	char *data;
+	size_t len;
+
+	if (length)
+		*length = 0;
+
+	file = fopen(fileName, "rb");
+	if (!file)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	len = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = (char *)malloc(len+1);
+	if (!data)
+	{
+		fclose(file);
+		return NULL;
+	}
+
+	if (fread(data, 1, len, file) != len) {
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+	data[len] = '\0';
+	fclose(file);
+
+	if (length)
+		*length = len;
+
+	return data;
+}
+
+// Reads a single UTF8 codepoint.
+const char *tigrDecodeUTF8(const char *text, int *cp)
+{
+	unsigned char c = *text++;
+	int extra = 0, min = 0;
+	*cp = 0;
+		 if (c >= 0xf0) { *cp = c & 0x07; extra = 3; min = 0x10000; }
+	else if (c >= 0xe0) { *cp = c & 0x0f; extra = 2; min = 0x800; }
+	else if (c >= 0xc0) { *cp = c & 0x1f; extra = 1; min = 0x80; }
+	else if (c >= 0x80) { *cp = 0xfffd; }
+	else *cp = c;
+	while (extra--) {
+		c = *text++;
+		if ((c & 0xc0) != 0x80) { *cp = 0xfffd; break; }
+		(*cp) = ((*cp) << 6) | (c & 0x3f);
+	}
+	if (*cp < min) *cp = 0xfffd;
+	return text;
+}
+
+char *tigrEncodeUTF8(char *text, int cp)
+{
+	if (cp < 0 || cp > 0x10ffff) cp = 0xfffd;
+
+#define EMIT(X,Y,Z) *text++ = X | ((cp >> Y)&Z)
+		 if (cp <     0x80) { EMIT(0x00,0,0x7f); }
+	else if (cp <    0x800) { EMIT(0xc0,6,0x1f); EMIT(0x80, 0, 0x3f); }
+	else if (cp <  0x10000) { EMIT(0xe0,12,0xf); EMIT(0x80, 6, 0x3f); EMIT(0x80, 0, 0x3f); }
+	else                    { EMIT(0xf0,18,0x7); EMIT(0x80, 12, 0x3f); EMIT(0x80, 6, 0x3f); EMIT(0x80, 0, 0x3f); }
+	return text;
+#undef EMIT
+}
+
+void tigrSetPostFX(Tigr *bmp, int hblur, int vblur, float scanlines, float contrast)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	win->hblur = hblur;
+	win->vblur = vblur;
+	win->scanlines = scanlines;
+	win->contrast = contrast;
+}
+
+//////// End of inlined file: tigr_utils.c ////////
+
+//////// Start of inlined file: tigr_inflate.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <setjmp.h>
+
+typedef struct {
+	unsigned bits, count;
+	const unsigned char *in, *inend;
+	unsigned char *out, *outend;
+	jmp_buf jmp;
+	unsigned litcodes[288], distcodes[32], lencodes[19];
+	int tlit, tdist, tlen;
+} State;
+
+#define FAIL() longjmp(s->jmp, 1)
+#define CHECK(X) if (!(X)) FAIL()
+
+// Built-in DEFLATE standard tables.
+static char order[] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+static char lenBits[29+2] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0,  0,0 };
+static int lenBase[29+2] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258,  0,0 };
+static char distBits[30+2] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13,  0,0 };
+static int distBase[30+2] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+
+// Table to bit-reverse a byte.
+static const unsigned char reverseTable[256] = {
+#define R2(n)    n,     n + 128,     n + 64,     n + 192
+#define R4(n) R2(n), R2(n +  32), R2(n + 16), R2(n +  48)
+#define R6(n) R4(n), R4(n +   8), R4(n +  4), R4(n +  12)
+	R6(0), R6(2), R6(1), R6(3)
+};
+
+static unsigned rev16(unsigned n) { return (reverseTable[n&0xff] << 8) | reverseTable[(n>>8)&0xff]; }
+
+static int bits(State *s, int n)
+{
+	int v = s->bits & ((1 << n)-1);
+	s->bits >>= n;
+	s->count -= n;
+	while (s->count < 16)
+	{
+		CHECK(s->in != s->inend);
+		s->bits |= (*s->in++) << s->count;
+		s->count += 8;
+	}
+	return v;
+}
+
+static unsigned char *emit(State *s, int len)
+{
+	s->out += len;
+	CHECK(s->out <= s->outend);
+	return s->out-len;
+}
+
+static void copy(State *s, const unsigned char *src, int len)
+{
+	unsigned char *dest = emit(s, len);
+	while (len--) *dest++ = *src++;
+}
+
+static int build(State *s, unsigned *tree, unsigned char *lens, int symcount)
+{
+	int n, codes[16], first[16], counts[16]={0};
+
+	// Frequency count.
+	for (n=0;n<symcount;n++) counts[lens[n]]++;
+
+	// Distribute codes.
+	counts[0] = codes[0] = first[0] = 0;
 	for (n=1;n<=15;n++) {
 		codes[n] = (codes[n-1] + counts[n-1]) << 1;
 		first[n] = first[n-1] + counts[n-1];
@@ -1460,10 +3634,11 @@ void tigrSetupFont(TigrFont *font)
 void tigrPrint(Tigr *dest, TigrFont *font, int x, int y, TPixel color, const char *text, ...)
 {
 	char tmp[1024];
+	TigrSprite sprites[64];
 	TigrGlyph *g;
 	va_list args;
 	const char *p;
-	int start = x, c;
+	int start = x, c, n = 0;
 
 	tigrSetupFont(font);
 
@@ -1486,9 +3661,23 @@ void tigrPrint(Tigr *dest, TigrFont *font, int x, int y, TPixel color, const cha
 			continue;
 		}
 		g = get(font, c);
-		tigrBlitTint(dest, font->bitmap, x, y, g->x, g->y, g->w, g->h, color);
+		sprites[n].sx = g->x; sprites[n].sy = g->y;
+		sprites[n].w = g->w; sprites[n].h = g->h;
+		sprites[n].dx = x; sprites[n].dy = y;
+		sprites[n].tint = color;
+		if (++n == 64) {
+			tigrBlitBatch(dest, font->bitmap, sprites, n);
+			n = 0;
+		}
 		x += g->w;
 	}
+	tigrBlitBatch(dest, font->bitmap, sprites, n);
+}
+
+void tigrPremultiplyFont(TigrFont *font)
+{
+	tigrSetupFont(font);
+	tigrPremultiply(font->bitmap);
 }
 
 int tigrTextWidth(TigrFont *font, const char *text)
@@ -1912,7 +4101,7 @@ void tigrDxUpdate(IDirect3DDevice9 *dev, IDirect3DTexture9 *sysTex, IDirect3DTex
 	{
 		dest = (TPixel *)( (char *)rect.pBits + rect.Pitch*y );
 		memcpy(dest, src, bmp->w*sizeof(TPixel));
-		src += bmp->w;
+		src += bmp->stride;
 	}
 
 	IDirect3DTexture9_UnlockRect(sysTex, 0);
@@ -2573,7 +4762,7 @@ void tigrFree(Tigr *bmp)
 		free(win->wtitle);
 		tigrFree(win->widgets);
 	}
-	free(bmp->pix);
+	tigrFreePixels(bmp->pix);
 	free(bmp);
 }
 
@@ -3145,7 +5334,7 @@ void tigrFree(Tigr *bmp)
 		if(!_tigrCocoaIsWindowClosed(window) && !terminated)
 			objc_msgSend_void(window, sel_registerName("close"));
 	}
-	free(bmp->pix);
+	tigrFreePixels(bmp->pix);
 	free(bmp);
 }
 
@@ -3490,110 +5679,684 @@ void _tigrOnCocoaEvent(id event, id window)
 		break;
 	}
 
-	objc_msgSend_void_id(NSApp, sel_registerName("sendEvent:"), event);
+	objc_msgSend_void_id(NSApp, sel_registerName("sendEvent:"), event);
+}
+
+void tigrUpdate(Tigr *bmp)
+{
+	TigrInternal *win;
+	id openGLContext;
+	id window;
+	win = tigrInternal(bmp);
+	window = (id)bmp->handle;
+	openGLContext = (id)win->glContext;
+
+	id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
+
+	if(keyWindow == window)
+		memcpy(win->prev, win->keys, 256);
+
+	id distantPast = objc_msgSend_id((id)objc_getClass("NSDate"), sel_registerName("distantPast"));
+	id event = ((id (*)(id, SEL, NSUInteger, id, id, BOOL))objc_msgSend)(NSApp, sel_registerName("nextEventMatchingMask:untilDate:inMode:dequeue:"), NSUIntegerMax, distantPast, NSDefaultRunLoopMode, YES);
+	_tigrOnCocoaEvent(event, keyWindow);
+	if(terminated || _tigrCocoaIsWindowClosed(window))
+		return;
+
+	// do runloop stuff
+	objc_msgSend_void(NSApp, sel_registerName("updateWindows"));
+	objc_msgSend_void(openGLContext, sel_registerName("update"));
+	objc_msgSend_void(openGLContext, sel_registerName("makeCurrentContext"));
+
+	NSSize windowSize = _tigrCocoaWindowSize(window);
+
+	if (win->flags & TIGR_AUTO)
+		tigrResize(bmp, windowSize.width / win->scale, windowSize.height / win->scale);
+	else
+		win->scale = tigrEnforceScale(tigrCalcScale(bmp->w, bmp->h, windowSize.width, windowSize.height), win->flags);
+
+	tigrPosition(bmp, win->scale, windowSize.width, windowSize.height, win->pos);
+	tigrGAPIResize(bmp, windowSize.width, windowSize.height);
+	tigrGAPIPresent(bmp, windowSize.width, windowSize.height);
+	objc_msgSend_void(openGLContext, sel_registerName("flushBuffer"));
+}
+
+int tigrClosed(Tigr *bmp)
+{
+	return (terminated || _tigrCocoaIsWindowClosed((id)bmp->handle)) ? 1 : 0;
+}
+
+void tigrMouse(Tigr *bmp, int *x, int *y, int *buttons)
+{
+	TigrInternal *win;
+	id window;
+	win = tigrInternal(bmp);
+	window = (id)bmp->handle;
+
+	id windowContentView = objc_msgSend_id(window, sel_registerName("contentView"));
+	NSRect adjustFrame = ((NSRect (*)(id, SEL))abi_objc_msgSend_stret)(windowContentView, sel_registerName("frame"));
+
+	// NSPoint is small enough to fit a register, so no need for objc_msgSend_stret
+	NSPoint p = ((NSPoint (*)(id, SEL))objc_msgSend)(window, sel_registerName("mouseLocationOutsideOfEventStream"));
+
+	// map input to content view rect
+	if(p.x < 0) p.x = 0;
+	else if(p.x > adjustFrame.size.width) p.x = adjustFrame.size.width;
+	if(p.y < 0) p.y = 0;
+	else if(p.y > adjustFrame.size.height) p.y = adjustFrame.size.height;
+
+	// map input to pixels
+	NSRect r = {p.x, p.y, 0, 0};
+	r = ((NSRect (*)(id, SEL, NSRect))abi_objc_msgSend_stret)(windowContentView, sel_registerName("convertRectToBacking:"), r);
+	p = r.origin;
+
+	p.x = (p.x - win->pos[0]) / win->scale;
+	p.y = (adjustFrame.size.height - p.y - win->pos[1]) / win->scale;
+
+	if(x)
+		*x = p.x;
+	if(y)
+		*y = p.y;
+
+	if(buttons)
+	{
+		id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
+		*buttons = keyWindow != bmp->handle ? 0 : win->mouseButtons;
+	}
+}
+
+int tigrKeyDown(Tigr *bmp, int key)
+{
+	TigrInternal *win;
+	assert(key < 256);
+	id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
+	if(keyWindow != bmp->handle)
+		return 0;
+	win = tigrInternal(bmp);
+	return win->keys[key] && !win->prev[key];
+}
+
+int tigrKeyHeld(Tigr *bmp, int key)
+{
+	TigrInternal *win;
+	assert(key < 256);
+	id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
+	if(keyWindow != bmp->handle)
+		return 0;
+	win = tigrInternal(bmp);
+	return win->keys[key];
+}
+
+int tigrReadChar(Tigr *bmp)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	int c = win->lastChar;
+	win->lastChar = 0;
+	return c;
+}
+
+float tigrTime()
+{
+	static uint64_t time = 0;
+	static mach_timebase_info_data_t timebaseInfo;
+
+	if(timebaseInfo.denom == 0)
+	{
+		mach_timebase_info(&timebaseInfo);
+		time = mach_absolute_time();
+		return 0.0f;
+	}
+
+	uint64_t current_time = mach_absolute_time();
+	double elapsed = (double)(current_time - time) * timebaseInfo.numer / (timebaseInfo.denom * 1000000000.0);
+	time = current_time;
+	return (float)elapsed;
+}
+
+#endif
+#endif
+
+//////// End of inlined file: tigr_osx.c ////////
+
+//////// Start of inlined file: tigr_offscreen.c ////////
+
+//#include "tigr_internal.h"
+// Helpers shared by the X11 and headless window backends.
+#if !defined(_WIN32) && !defined(__APPLE__)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+void tigrError(Tigr *bmp, const char *message, ...)
+{
+	va_list args;
+	(void)bmp;
+
+	va_start(args, message);
+	vfprintf(stderr, message, args);
+	va_end(args);
+	fputc('\n', stderr);
+	exit(1);
+}
+
+float tigrTime()
+{
+	static int first = 1;
+	static struct timespec prev;
+
+	struct timespec cnt;
+	double diff;
+	clock_gettime(CLOCK_MONOTONIC, &cnt);
+
+	if (first)
+	{
+		first = 0;
+		prev = cnt;
+	}
+
+	diff = (double)(cnt.tv_sec - prev.tv_sec) + (cnt.tv_nsec - prev.tv_nsec) / 1000000000.0;
+	prev = cnt;
+	return (float)diff;
+}
+
+#endif
+
+//////// End of inlined file: tigr_offscreen.c ////////
+
+//////// Start of inlined file: tigr_x11.c ////////
+
+//#include "tigr_internal.h"
+// X11 window backend. There's no GPU path: every tigrUpdate scales the
+// rows that changed since the last one into a window-sized XImage on the
+// CPU, and puts just those rows. The image lives in shared memory when
+// the server has MIT-SHM, so pixels never go through the socket; remote
+// displays (or TIGR_NO_SHM in the environment) fall back to XPutImage.
+// Post-FX and the widgets aren't drawn.
+#if defined(TIGR_X11) && !defined(TIGR_HEADLESS) && !defined(_WIN32) && !defined(__APPLE__)
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/keysym.h>
+#include <X11/XKBlib.h>
+
+static int tigrX11ShmError;
+
+static int tigrX11TrapShmError(Display *dpy, XErrorEvent *ev)
+{
+	(void)dpy; (void)ev;
+	tigrX11ShmError = 1;
+	return 0;
+}
+
+static void tigrX11FreeImage(X11Stuff *x)
+{
+	if (!x->img)
+		return;
+
+	if (x->useShm) {
+		XShmDetach(x->dpy, &x->shm);
+		XSync(x->dpy, False);
+		XDestroyImage(x->img);
+		shmdt(x->shm.shmaddr);
+	} else {
+		XDestroyImage(x->img);
+	}
+	x->img = NULL;
+	x->shmPending = 0;
+}
+
+// (Re)creates the window-sized image, in shared memory when possible.
+static void tigrX11CreateImage(X11Stuff *x, int w, int h)
+{
+	int (*handler)(Display *, XErrorEvent *);
+	char *data;
+
+	tigrX11FreeImage(x);
+	if (w < 1) w = 1;
+	if (h < 1) h = 1;
+
+	x->img = NULL;
+	if (x->useShm) {
+		x->img = XShmCreateImage(x->dpy, x->visual, x->depth, ZPixmap, NULL, &x->shm, w, h);
+		if (x->img) {
+			x->shm.shmid = shmget(IPC_PRIVATE, x->img->bytes_per_line * h, IPC_CREAT|0600);
+			x->shm.shmaddr = x->shm.shmid < 0 ? (char *)-1 : (char *)shmat(x->shm.shmid, NULL, 0);
+			if (x->shm.shmaddr != (char *)-1) {
+				x->img->data = x->shm.shmaddr;
+				x->shm.readOnly = False;
+
+				// Attaching fails on displays that can't see our memory.
+				tigrX11ShmError = 0;
+				handler = XSetErrorHandler(tigrX11TrapShmError);
+				XShmAttach(x->dpy, &x->shm);
+				XSync(x->dpy, False);
+				XSetErrorHandler(handler);
+
+				if (!tigrX11ShmError) {
+					// Freed once both sides detach.
+					shmctl(x->shm.shmid, IPC_RMID, NULL);
+				} else {
+					shmdt(x->shm.shmaddr);
+					x->shm.shmaddr = (char *)-1;
+				}
+			}
+			if (x->shm.shmid >= 0 && x->shm.shmaddr == (char *)-1)
+				shmctl(x->shm.shmid, IPC_RMID, NULL);
+			if (x->shm.shmaddr == (char *)-1) {
+				x->img->data = NULL;
+				XDestroyImage(x->img);
+				x->img = NULL;
+			}
+		}
+		x->useShm = x->img != NULL;
+	}
+
+	if (!x->img) {
+		x->img = XCreateImage(x->dpy, x->visual, x->depth, ZPixmap, 0, NULL, w, h, 32, 0);
+		if (!x->img)
+			tigrError(NULL, "Cannot create an X image.");
+		data = (char *)calloc(x->img->bytes_per_line, h);
+		if (!data)
+			tigrError(NULL, "Out of memory.");
+		x->img->data = data;
+	}
+
+	x->width = w;
+	x->height = h;
+	x->frame.w = w;
+	x->frame.h = h;
+	x->frame.pix = (TPixel *)x->img->data;
+	x->frame.handle = NULL;
+	x->frame.premultiplied = 0;
+	x->frame.stride = x->img->bytes_per_line / (int)sizeof(TPixel);
+	x->full = 1;
+}
+
+static int tigrX11Key(XKeyEvent *ev)
+{
+	KeySym sym = XLookupKeysym(ev, 1);
+
+	// Keypad digits only show up in the second column.
+	if (sym >= XK_KP_0 && sym <= XK_KP_9)
+		return TK_PAD0 + (int)(sym - XK_KP_0);
+	if (sym == XK_KP_Decimal)
+		return TK_PADDOT;
+
+	sym = XLookupKeysym(ev, 0);
+	if (sym >= XK_a && sym <= XK_z)
+		return 'A' + (int)(sym - XK_a);
+	if (sym >= XK_0 && sym <= XK_9)
+		return '0' + (int)(sym - XK_0);
+	if (sym >= XK_F1 && sym <= XK_F12)
+		return TK_F1 + (int)(sym - XK_F1);
+
+	switch (sym) {
+	case XK_KP_Multiply: return TK_PADMUL;
+	case XK_KP_Add: return TK_PADADD;
+	case XK_KP_Enter: return TK_PADENTER;
+	case XK_KP_Subtract: return TK_PADSUB;
+	case XK_KP_Divide: return TK_PADDIV;
+	case XK_BackSpace: return TK_BACKSPACE;
+	case XK_Tab: return TK_TAB;
+	case XK_Return: return TK_RETURN;
+	case XK_Pause: return TK_PAUSE;
+	case XK_Caps_Lock: return TK_CAPSLOCK;
+	case XK_Escape: return TK_ESCAPE;
+	case XK_space: return TK_SPACE;
+	case XK_Prior: return TK_PAGEUP;
+	case XK_Next: return TK_PAGEDN;
+	case XK_End: return TK_END;
+	case XK_Home: return TK_HOME;
+	case XK_Left: return TK_LEFT;
+	case XK_Up: return TK_UP;
+	case XK_Right: return TK_RIGHT;
+	case XK_Down: return TK_DOWN;
+	case XK_Insert: return TK_INSERT;
+	case XK_Delete: return TK_DELETE;
+	case XK_Super_L: return TK_LWIN;
+	case XK_Super_R: return TK_RWIN;
+	case XK_Num_Lock: return TK_NUMLOCK;
+	case XK_Scroll_Lock: return TK_SCROLL;
+	case XK_Shift_L: return TK_LSHIFT;
+	case XK_Shift_R: return TK_RSHIFT;
+	case XK_Control_L: return TK_LCONTROL;
+	case XK_Control_R: return TK_RCONTROL;
+	case XK_Alt_L: return TK_LALT;
+	case XK_Alt_R: return TK_RALT;
+	case XK_semicolon: return TK_SEMICOLON;
+	case XK_equal: return TK_EQUALS;
+	case XK_comma: return TK_COMMA;
+	case XK_minus: return TK_MINUS;
+	case XK_period: return TK_DOT;
+	case XK_slash: return TK_SLASH;
+	case XK_grave: return TK_BACKTICK;
+	case XK_bracketleft: return TK_LSQUARE;
+	case XK_backslash: return TK_BACKSLASH;
+	case XK_bracketright: return TK_RSQUARE;
+	case XK_apostrophe: return TK_TICK;
+	}
+	return 0;
+}
+
+static void tigrX11SetKey(TigrInternal *win, int key, int down)
+{
+	win->keys[key] = (char)down;
+
+	// Either side also counts as the plain modifier.
+	if (key == TK_LSHIFT || key == TK_RSHIFT)
+		win->keys[TK_SHIFT] = win->keys[TK_LSHIFT] || win->keys[TK_RSHIFT];
+	if (key == TK_LCONTROL || key == TK_RCONTROL)
+		win->keys[TK_CONTROL] = win->keys[TK_LCONTROL] || win->keys[TK_RCONTROL];
+	if (key == TK_LALT || key == TK_RALT)
+		win->keys[TK_ALT] = win->keys[TK_LALT] || win->keys[TK_RALT];
+}
+
+static void tigrX11HandleEvent(Tigr *bmp, XEvent *ev)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	X11Stuff *x = &win->x11;
+	char text[8];
+	KeySym sym;
+	int key;
+
+	if (ev->type == x->shmCompletion) {
+		if (x->shmPending > 0)
+			x->shmPending--;
+		return;
+	}
+
+	switch (ev->type) {
+	case ClientMessage:
+		if ((Atom)ev->xclient.data.l[0] == x->wmDeleteWindow)
+			win->closed = 1;
+		break;
+	case Expose:
+		if (ev->xexpose.count == 0)
+			x->full = 1;
+		break;
+	case ConfigureNotify:
+		x->windowW = ev->xconfigure.width;
+		x->windowH = ev->xconfigure.height;
+		break;
+	case FocusOut:
+		memset(win->keys, 0, sizeof(win->keys));
+		x->mouseButtons = 0;
+		break;
+	case KeyPress:
+		key = tigrX11Key(&ev->xkey);
+		if (key)
+			tigrX11SetKey(win, key, 1);
+		if (XLookupString(&ev->xkey, text, sizeof(text), &sym, NULL) == 1 && (unsigned char)text[0] >= 32)
+			win->lastChar = (unsigned char)text[0];
+		break;
+	case KeyRelease:
+		key = tigrX11Key(&ev->xkey);
+		if (key)
+			tigrX11SetKey(win, key, 0);
+		break;
+	case ButtonPress:
+		if (ev->xbutton.button >= Button1 && ev->xbutton.button <= Button3)
+			x->mouseButtons |= 1 << (ev->xbutton.button - Button1);
+		break;
+	case ButtonRelease:
+		if (ev->xbutton.button >= Button1 && ev->xbutton.button <= Button3)
+			x->mouseButtons &= ~(1 << (ev->xbutton.button - Button1));
+		break;
+	case MotionNotify:
+		x->mouseX = ev->xmotion.x;
+		x->mouseY = ev->xmotion.y;
+		break;
+	}
+}
+
+// Waits until the server has read every put image, so img can be reused.
+static void tigrX11WaitForShm(Tigr *bmp)
+{
+	X11Stuff *x = &tigrInternal(bmp)->x11;
+	XEvent ev;
+
+	while (x->shmPending > 0) {
+		XNextEvent(x->dpy, &ev);
+		tigrX11HandleEvent(bmp, &ev);
+	}
+}
+
+// Puts window rows [y, y + h) of the bitmap's rect.
+static void tigrX11Put(X11Stuff *x, int *pos, int y, int h)
+{
+	int x1 = pos[0] < 0 ? 0 : pos[0];
+	int x2 = pos[2] > x->width ? x->width : pos[2];
+	if (y < 0) { h += y; y = 0; }
+	if (y + h > x->height) h = x->height - y;
+	if (x1 >= x2 || h <= 0)
+		return;
+
+	if (x->useShm) {
+		XShmPutImage(x->dpy, x->window, x->gc, x->img, x1, y, x1, y, x2 - x1, h, True);
+		x->shmPending++;
+	} else {
+		XPutImage(x->dpy, x->window, x->gc, x->img, x1, y, x1, y, x2 - x1, h);
+	}
+}
+
+static void tigrX11Present(Tigr *bmp)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	X11Stuff *x = &win->x11;
+	int y, first, scale = win->scale;
+	int sw = bmp->w * scale, sh = bmp->h * scale;
+	size_t row = bmp->w * sizeof(TPixel);
+
+	tigrX11WaitForShm(bmp);
+
+	if (!x->presented || x->presented->w != bmp->w || x->presented->h != bmp->h) {
+		if (x->presented)
+			tigrFree(x->presented);
+		x->presented = tigrBitmap(bmp->w, bmp->h);
+		x->full = 1;
+	}
+
+	if (x->full) {
+		tigrClear(&x->frame, tigrRGB(0, 0, 0));
+		tigrBlitScaled(&x->frame, bmp, win->pos[0], win->pos[1], sw, sh);
+		for (y=0;y<bmp->h;y++)
+			memcpy(&x->presented->pix[y*x->presented->stride], &bmp->pix[y*bmp->stride], row);
+		if (x->useShm) {
+			XShmPutImage(x->dpy, x->window, x->gc, x->img, 0, 0, 0, 0, x->width, x->height, True);
+			x->shmPending++;
+		} else {
+			XPutImage(x->dpy, x->window, x->gc, x->img, 0, 0, 0, 0, x->width, x->height);
+		}
+		x->full = 0;
+		XFlush(x->dpy);
+		return;
+	}
+
+	// Only rows that differ from the last frame are scaled and sent.
+	for (y=0;y<bmp->h;) {
+		if (!memcmp(&x->presented->pix[y*x->presented->stride], &bmp->pix[y*bmp->stride], row)) {
+			y++;
+			continue;
+		}
+
+		first = y;
+		do {
+			memcpy(&x->presented->pix[y*x->presented->stride], &bmp->pix[y*bmp->stride], row);
+			y++;
+		} while (y < bmp->h && memcmp(&x->presented->pix[y*x->presented->stride], &bmp->pix[y*bmp->stride], row));
+
+		tigrBlitScaledRows(&x->frame, bmp, win->pos[0], win->pos[1], sw, sh, first*scale, y*scale);
+		tigrX11Put(x, win->pos, win->pos[1] + first*scale, (y - first)*scale);
+	}
+	XFlush(x->dpy);
 }
 
-void tigrUpdate(Tigr *bmp)
+Tigr *tigrWindow(int w, int h, const char *title, int flags)
 {
+	Display *dpy;
+	XVisualInfo vi;
+	XSetWindowAttributes attr;
+	Window window, root;
+	Tigr *bmp;
 	TigrInternal *win;
-	id openGLContext;
-	id window;
-	win = tigrInternal(bmp);
-	window = (id)bmp->handle;
-	openGLContext = (id)win->glContext;
+	int screen, scale, major, minor;
+	Bool pixmaps;
+
+	dpy = XOpenDisplay(NULL);
+	if (!dpy)
+		tigrError(NULL, "Cannot open the X display.");
+	screen = DefaultScreen(dpy);
+	root = RootWindow(dpy, screen);
+
+	// Pixels are stored as B,G,R,A bytes, which is what a little-endian
+	// 24-bit TrueColor visual wants.
+	if (!XMatchVisualInfo(dpy, screen, 24, TrueColor, &vi)
+	 || vi.red_mask != 0xff0000 || vi.green_mask != 0xff00 || vi.blue_mask != 0xff
+	 || ImageByteOrder(dpy) != LSBFirst)
+		tigrError(NULL, "This X display has no 24-bit BGRA visual.");
 
-	id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
+	if (flags & TIGR_AUTO)
+	{
+		// Always use a 1:1 pixel size.
+		scale = 1;
+	} else {
+		// See how big we can make it and still fit on-screen.
+		scale = tigrCalcScale(w, h, DisplayWidth(dpy, screen) * 3/4, DisplayHeight(dpy, screen) * 3/4);
+	}
 
-	if(keyWindow == window)
-		memcpy(win->prev, win->keys, 256);
+	scale = tigrEnforceScale(scale, flags);
 
-	id distantPast = objc_msgSend_id((id)objc_getClass("NSDate"), sel_registerName("distantPast"));
-	id event = ((id (*)(id, SEL, NSUInteger, id, id, BOOL))objc_msgSend)(NSApp, sel_registerName("nextEventMatchingMask:untilDate:inMode:dequeue:"), NSUIntegerMax, distantPast, NSDefaultRunLoopMode, YES);
-	_tigrOnCocoaEvent(event, keyWindow);
-	if(terminated || _tigrCocoaIsWindowClosed(window))
-		return;
+	attr.colormap = XCreateColormap(dpy, root, vi.visual, AllocNone);
+	attr.background_pixel = 0;
+	attr.border_pixel = 0;
+	attr.event_mask = ExposureMask | StructureNotifyMask | FocusChangeMask | KeyPressMask | KeyReleaseMask
+		| ButtonPressMask | ButtonReleaseMask | PointerMotionMask;
+	window = XCreateWindow(dpy, root, 0, 0, w*scale, h*scale, 0, vi.depth, InputOutput, vi.visual,
+		CWColormap | CWBackPixel | CWBorderPixel | CWEventMask, &attr);
+	if (!window)
+		tigrError(NULL, "Cannot create an X window.");
 
-	// do runloop stuff
-	objc_msgSend_void(NSApp, sel_registerName("updateWindows"));
-	objc_msgSend_void(openGLContext, sel_registerName("update"));
-	objc_msgSend_void(openGLContext, sel_registerName("makeCurrentContext"));
+	Xutf8SetWMProperties(dpy, window, title, title, NULL, 0, NULL, NULL, NULL);
 
-	NSSize windowSize = _tigrCocoaWindowSize(window);
+	// Wrap a bitmap around it.
+	bmp = tigrBitmap2(w, h, sizeof(TigrInternal));
+	bmp->handle = (void *)(uintptr_t)window;
 
-	if (win->flags & TIGR_AUTO)
-		tigrResize(bmp, windowSize.width / win->scale, windowSize.height / win->scale);
-	else
-		win->scale = tigrEnforceScale(tigrCalcScale(bmp->w, bmp->h, windowSize.width, windowSize.height), win->flags);
+	win = tigrInternal(bmp);
+	win->shown = 0;
+	win->closed = 0;
+	win->scale = scale;
+	win->lastChar = 0;
+	win->flags = flags;
+	win->hblur = win->vblur = 0;
+	win->scanlines = 0.0f;
+	win->contrast = 1.0f;
+	win->widgets = NULL;
+	win->widgetsWanted = 0;
+	win->widgetAlpha = 0;
+	win->widgetsScale = 0;
 
-	tigrPosition(bmp, win->scale, windowSize.width, windowSize.height, win->pos);
-	tigrGAPIResize(bmp, windowSize.width, windowSize.height);
-	tigrGAPIPresent(bmp, windowSize.width, windowSize.height);
-	objc_msgSend_void(openGLContext, sel_registerName("flushBuffer"));
+	win->x11.dpy = dpy;
+	win->x11.window = window;
+	win->x11.gc = XCreateGC(dpy, window, 0, NULL);
+	win->x11.wmDeleteWindow = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
+	XSetWMProtocols(dpy, window, &win->x11.wmDeleteWindow, 1);
+
+	// Key repeat sends presses only, so tigrKeyHeld doesn't flicker.
+	XkbSetDetectableAutoRepeat(dpy, True, NULL);
+
+	win->x11.useShm = XShmQueryVersion(dpy, &major, &minor, &pixmaps) && getenv("TIGR_NO_SHM") == NULL;
+	win->x11.shmCompletion = XShmGetEventBase(dpy) + ShmCompletion;
+	win->x11.visual = vi.visual;
+	win->x11.depth = vi.depth;
+	win->x11.windowW = w*scale;
+	win->x11.windowH = h*scale;
+	tigrX11CreateImage(&win->x11, w*scale, h*scale);
+
+	tigrPosition(bmp, win->scale, win->x11.width, win->x11.height, win->pos);
+
+	XMapWindow(dpy, window);
+	XFlush(dpy);
+	return bmp;
 }
 
-int tigrClosed(Tigr *bmp)
+void tigrFree(Tigr *bmp)
 {
-	return (terminated || _tigrCocoaIsWindowClosed((id)bmp->handle)) ? 1 : 0;
+	if (bmp->handle)
+	{
+		X11Stuff *x = &tigrInternal(bmp)->x11;
+		tigrX11WaitForShm(bmp);
+		tigrX11FreeImage(x);
+		if (x->presented)
+			tigrFree(x->presented);
+		XFreeGC(x->dpy, x->gc);
+		XDestroyWindow(x->dpy, x->window);
+		XCloseDisplay(x->dpy);
+	}
+	tigrFreePixels(bmp->pix);
+	free(bmp);
 }
 
-void tigrMouse(Tigr *bmp, int *x, int *y, int *buttons)
+int tigrClosed(Tigr *bmp)
 {
-	TigrInternal *win;
-	id window;
-	win = tigrInternal(bmp);
-	window = (id)bmp->handle;
+	TigrInternal *win = tigrInternal(bmp);
+	int val = win->closed;
+	win->closed = 0;
+	return val;
+}
 
-	id windowContentView = objc_msgSend_id(window, sel_registerName("contentView"));
-	NSRect adjustFrame = ((NSRect (*)(id, SEL))abi_objc_msgSend_stret)(windowContentView, sel_registerName("frame"));
+void tigrUpdate(Tigr *bmp)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	X11Stuff *x = &win->x11;
+	XEvent ev;
 
-	// NSPoint is small enough to fit a register, so no need for objc_msgSend_stret
-	NSPoint p = ((NSPoint (*)(id, SEL))objc_msgSend)(window, sel_registerName("mouseLocationOutsideOfEventStream"));
+	memcpy(win->prev, win->keys, 256);
 
-	// map input to content view rect
-	if(p.x < 0) p.x = 0;
-	else if(p.x > adjustFrame.size.width) p.x = adjustFrame.size.width;
-	if(p.y < 0) p.y = 0;
-	else if(p.y > adjustFrame.size.height) p.y = adjustFrame.size.height;
+	while (XPending(x->dpy)) {
+		XNextEvent(x->dpy, &ev);
+		tigrX11HandleEvent(bmp, &ev);
+	}
 
-	// map input to pixels
-	NSRect r = {p.x, p.y, 0, 0};
-	r = ((NSRect (*)(id, SEL, NSRect))abi_objc_msgSend_stret)(windowContentView, sel_registerName("convertRectToBacking:"), r);
-	p = r.origin;
+	if (x->windowW != x->width || x->windowH != x->height) {
+		tigrX11WaitForShm(bmp);
+		tigrX11CreateImage(x, x->windowW, x->windowH);
+	}
 
-	p.x = (p.x - win->pos[0]) / win->scale;
-	p.y = (adjustFrame.size.height - p.y - win->pos[1]) / win->scale;
+	if (win->flags & TIGR_AUTO)
+		tigrResize(bmp, x->width / win->scale, x->height / win->scale);
+	else
+		win->scale = tigrEnforceScale(tigrCalcScale(bmp->w, bmp->h, x->width, x->height), win->flags);
 
-	if(x)
-		*x = p.x;
-	if(y)
-		*y = p.y;
+	tigrPosition(bmp, win->scale, x->width, x->height, win->pos);
+	tigrX11Present(bmp);
+}
 
-	if(buttons)
-	{
-		id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
-		*buttons = keyWindow != bmp->handle ? 0 : win->mouseButtons;
-	}
+void tigrMouse(Tigr *bmp, int *x, int *y, int *buttons)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	if (x)
+		*x = (win->x11.mouseX - win->pos[0]) / win->scale;
+	if (y)
+		*y = (win->x11.mouseY - win->pos[1]) / win->scale;
+	if (buttons)
+		*buttons = win->x11.mouseButtons;
 }
 
 int tigrKeyDown(Tigr *bmp, int key)
 {
-	TigrInternal *win;
+	TigrInternal *win = tigrInternal(bmp);
 	assert(key < 256);
-	id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
-	if(keyWindow != bmp->handle)
-		return 0;
-	win = tigrInternal(bmp);
 	return win->keys[key] && !win->prev[key];
 }
 
 int tigrKeyHeld(Tigr *bmp, int key)
 {
-	TigrInternal *win;
+	TigrInternal *win = tigrInternal(bmp);
 	assert(key < 256);
-	id keyWindow = objc_msgSend_id(NSApp, sel_registerName("keyWindow"));
-	if(keyWindow != bmp->handle)
-		return 0;
-	win = tigrInternal(bmp);
 	return win->keys[key];
 }
 
@@ -3605,28 +6368,253 @@ int tigrReadChar(Tigr *bmp)
 	return c;
 }
 
-float tigrTime()
+#endif
+
+//////// End of inlined file: tigr_x11.c ////////
+
+//////// Start of inlined file: tigr_headless.c ////////
+
+//#include "tigr_internal.h"
+// Null window backend: windows are plain bitmaps that get published to a
+// ring of copies, a shared-memory segment and/or a raw file on every
+// tigrUpdate, with input played back from a script.
+#ifdef TIGR_HEADLESS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static void tigrHeadlessRunScript(Tigr *bmp)
 {
-	static uint64_t time = 0;
-	static mach_timebase_info_data_t timebaseInfo;
+	TigrInternal *win = tigrInternal(bmp);
+	HeadlessStuff *hl = &win->headless;
 
-	if(timebaseInfo.denom == 0)
+	if (hl->script)
+		hl->script(bmp, &hl->input, hl->userdata);
+	memcpy(win->keys, hl->input.keys, 256);
+}
+
+static void tigrHeadlessCopy(TPixel *dst, int dstStride, Tigr *src, int w, int h)
+{
+	int y;
+	for (y=0;y<h;y++)
+		memcpy(dst + y*dstStride, src->pix + y*src->stride, w*sizeof(TPixel));
+}
+
+static void tigrHeadlessPublish(Tigr *bmp)
+{
+	HeadlessStuff *hl = &tigrInternal(bmp)->headless;
+	TigrShmHeader *hdr = hl->shm;
+	Tigr *slot;
+	int y, w, h;
+
+	if (hl->ringSize > 0) {
+		slot = hl->ring[hl->input.frame % hl->ringSize];
+		if (!slot || slot->w != bmp->w || slot->h != bmp->h) {
+			if (slot)
+				tigrFree(slot);
+			slot = hl->ring[hl->input.frame % hl->ringSize] = tigrBitmap(bmp->w, bmp->h);
+		}
+		tigrHeadlessCopy(slot->pix, slot->stride, bmp, bmp->w, bmp->h);
+	}
+
+	if (hdr) {
+		// The segment keeps the size it was made with.
+		w = bmp->w < (int)hdr->width ? bmp->w : (int)hdr->width;
+		h = bmp->h < (int)hdr->height ? bmp->h : (int)hdr->height;
+		__atomic_store_n(&hdr->sequence, hdr->sequence + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		tigrHeadlessCopy((TPixel *)(hdr + 1), hdr->width, bmp, w, h);
+		hdr->frame = hl->input.frame;
+		__atomic_store_n(&hdr->sequence, hdr->sequence + 1, __ATOMIC_RELEASE);
+	}
+
+	if (hl->file) {
+		for (y=0;y<bmp->h;y++) {
+			if (fwrite(bmp->pix + y*bmp->stride, sizeof(TPixel), bmp->w, hl->file) != (size_t)bmp->w) {
+				// Stop writing rather than leave a torn stream behind.
+				fclose(hl->file);
+				hl->file = NULL;
+				break;
+			}
+		}
+	}
+}
+
+static void tigrHeadlessCloseShm(HeadlessStuff *hl)
+{
+	if (hl->shm) {
+		munmap(hl->shm, hl->shmSize);
+		hl->shm = NULL;
+	}
+}
+
+Tigr *tigrWindow(int w, int h, const char *title, int flags)
+{
+	Tigr *bmp;
+	TigrInternal *win;
+	(void)title;
+
+	bmp = tigrBitmap2(w, h, sizeof(TigrInternal));
+	// There's no OS window, but tigrInternal wants a handle.
+	bmp->handle = bmp;
+
+	win = tigrInternal(bmp);
+	win->scale = 1;
+	win->flags = flags;
+	win->contrast = 1.0f;
+	tigrPosition(bmp, win->scale, w, h, win->pos);
+	return bmp;
+}
+
+void tigrFree(Tigr *bmp)
+{
+	if (bmp->handle)
 	{
-		mach_timebase_info(&timebaseInfo);
-		time = mach_absolute_time();
-		return 0.0f;
+		HeadlessStuff *hl = &tigrInternal(bmp)->headless;
+		tigrHeadlessRing(bmp, 0);
+		tigrHeadlessCloseShm(hl);
+		if (hl->file)
+			fclose(hl->file);
 	}
+	tigrFreePixels(bmp->pix);
+	free(bmp);
+}
 
-	uint64_t current_time = mach_absolute_time();
-	double elapsed = (double)(current_time - time) * timebaseInfo.numer / (timebaseInfo.denom * 1000000000.0);
-	time = current_time;
-	return (float)elapsed;
+void tigrHeadlessInput(Tigr *bmp, TigrInputScript script, void *userdata)
+{
+	HeadlessStuff *hl = &tigrInternal(bmp)->headless;
+	hl->script = script;
+	hl->userdata = userdata;
+	tigrHeadlessRunScript(bmp);
+}
+
+void tigrHeadlessRing(Tigr *bmp, int frames)
+{
+	HeadlessStuff *hl = &tigrInternal(bmp)->headless;
+	int i;
+
+	for (i=0;i<hl->ringSize;i++) {
+		if (hl->ring[i])
+			tigrFree(hl->ring[i]);
+	}
+	free(hl->ring);
+	hl->ring = NULL;
+	hl->ringSize = 0;
+
+	if (frames > 0) {
+		hl->ring = (Tigr **)calloc(frames, sizeof(Tigr *));
+		if (hl->ring)
+			hl->ringSize = frames;
+	}
+}
+
+Tigr *tigrHeadlessFrame(Tigr *bmp, int age)
+{
+	HeadlessStuff *hl = &tigrInternal(bmp)->headless;
+	if (age < 0 || age >= hl->ringSize || age >= hl->input.frame)
+		return NULL;
+	return hl->ring[(hl->input.frame - 1 - age) % hl->ringSize];
+}
+
+int tigrHeadlessShm(Tigr *bmp, const char *name)
+{
+	HeadlessStuff *hl = &tigrInternal(bmp)->headless;
+	size_t size = sizeof(TigrShmHeader) + (size_t)bmp->w * bmp->h * sizeof(TPixel);
+	void *mem;
+	int fd;
+
+	tigrHeadlessCloseShm(hl);
+
+	fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+	if (fd < 0)
+		return 0;
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return 0;
+	}
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+		return 0;
+
+	hl->shm = (TigrShmHeader *)mem;
+	hl->shmSize = size;
+	memset(hl->shm, 0, sizeof(TigrShmHeader));
+	hl->shm->width = bmp->w;
+	hl->shm->height = bmp->h;
+	__atomic_store_n(&hl->shm->magic, TIGR_SHM_MAGIC, __ATOMIC_RELEASE);
+	return 1;
+}
+
+int tigrHeadlessFile(Tigr *bmp, const char *fileName)
+{
+	HeadlessStuff *hl = &tigrInternal(bmp)->headless;
+
+	if (hl->file)
+		fclose(hl->file);
+	hl->file = fopen(fileName, "wb");
+	return hl->file != NULL;
+}
+
+int tigrClosed(Tigr *bmp)
+{
+	TigrInput *input = &tigrInternal(bmp)->headless.input;
+	int val = input->closed;
+	input->closed = 0;
+	return val;
+}
+
+void tigrUpdate(Tigr *bmp)
+{
+	TigrInternal *win = tigrInternal(bmp);
+
+	tigrHeadlessPublish(bmp);
+	win->headless.input.frame++;
+
+	memcpy(win->prev, win->keys, 256);
+	tigrHeadlessRunScript(bmp);
+}
+
+void tigrMouse(Tigr *bmp, int *x, int *y, int *buttons)
+{
+	TigrInput *input = &tigrInternal(bmp)->headless.input;
+	if (x)
+		*x = input->mouseX;
+	if (y)
+		*y = input->mouseY;
+	if (buttons)
+		*buttons = input->mouseButtons;
+}
+
+int tigrKeyDown(Tigr *bmp, int key)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	assert(key < 256);
+	return win->keys[key] && !win->prev[key];
+}
+
+int tigrKeyHeld(Tigr *bmp, int key)
+{
+	TigrInternal *win = tigrInternal(bmp);
+	assert(key < 256);
+	return win->keys[key];
+}
+
+int tigrReadChar(Tigr *bmp)
+{
+	TigrInput *input = &tigrInternal(bmp)->headless.input;
+	int c = input->lastChar;
+	input->lastChar = 0;
+	return c;
 }
 
-#endif
 #endif
 
-//////// End of inlined file: tigr_osx.c ////////
+//////// End of inlined file: tigr_headless.c ////////
 
 //////// Start of inlined file: tigr_gl.c ////////
 
@@ -3909,7 +6897,9 @@ void tigrGAPIResize(Tigr *bmp, int width, int height)
 void tigrGAPIDraw(int legacy, GLuint uniform_model, GLuint tex, Tigr *bmp, int x1, int y1, int x2, int y2)
 {
 	glBindTexture(GL_TEXTURE_2D, tex);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, bmp->stride);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bmp->w, bmp->h, 0, GL_BGRA, GL_UNSIGNED_BYTE, bmp->pix);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
 	if(!legacy)
 	{
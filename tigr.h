@@ -23,10 +23,17 @@ extern "C" {
 #endif
 
 // Graphics configuration.
+// Other platforms get an X11 window presented from the CPU when built with
+// TIGR_X11. Without it, or with TIGR_HEADLESS, windows are headless.
 #ifdef _WIN32
 #define TIGR_GAPI_D3D9
-#else
+#elif defined(__APPLE__)
 #define TIGR_GAPI_GL
+#elif !defined(TIGR_X11) && !defined(TIGR_HEADLESS)
+#define TIGR_HEADLESS
+#endif
+#if defined(TIGR_HEADLESS) && (defined(_WIN32) || defined(__APPLE__))
+#error "TIGR_HEADLESS can only replace the X11 backend"
 #endif
 
 // Compiler configuration.
@@ -56,12 +63,15 @@ typedef struct Tigr {
 	int w, h;		// width/height (unscaled)
 	TPixel *pix;	// pixel data
 	void *handle;	// OS window handle, NULL for off-screen bitmaps.
+	int premultiplied;	// color channels are stored multiplied by alpha
+	int stride;		// pixels from one row to the next, w rounded up to a multiple of 16
 } Tigr;
 
 // Creates a new empty window. (title is UTF-8)
 Tigr *tigrWindow(int w, int h, const char *title, int flags);
 
-// Creates an empty off-screen bitmap.
+// Creates an empty off-screen bitmap. Pixel data is 64-byte aligned and
+// rows are padded, so pixel (x, y) is pix[y*stride + x].
 Tigr *tigrBitmap(int w, int h);
 
 // Deletes a window/bitmap.
@@ -96,6 +106,19 @@ void tigrFill(Tigr *bmp, int x, int y, int w, int h, TPixel color);
 // Draws an empty rectangle. (exclusive co-ords)
 void tigrRect(Tigr *bmp, int x, int y, int w, int h, TPixel color);
 
+// Draws a rectangle's outline like tigrRect and fills the inside like tigrFill.
+void tigrFillRect(Tigr *bmp, int x, int y, int w, int h, TPixel fill, TPixel outline);
+
+// One rectangle for tigrFillRects.
+typedef struct {
+	int x, y, w, h;
+	TPixel color;
+} TigrRect;
+
+// Fills many rectangles in one call, in order. Unlike tigrFill, colors
+// that aren't opaque are blended like tigrPlot.
+void tigrFillRects(Tigr *bmp, const TigrRect *rects, int count);
+
 // Draws a line.
 void tigrLine(Tigr *bmp, int x0, int y0, int x1, int y1, TPixel color);
 
@@ -112,6 +135,34 @@ void tigrBlitAlpha(Tigr *dest, Tigr *src, int dx, int dy, int sx, int sy, int w,
 // Same as tigrBlit, but tints the source bitmap with a color.
 void tigrBlitTint(Tigr *dest, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint);
 
+// One sprite for tigrBlitBatch: copy the w*h source rect at sx/sy to dx/dy.
+typedef struct {
+	int sx, sy, w, h;
+	int dx, dy;
+	TPixel tint;
+} TigrSprite;
+
+// Same as calling tigrBlitTint for each sprite in order, but all sprites
+// are clipped up front and the destination is swept top to bottom in
+// bands of rows. Sprites that overlap still stack in the order given.
+void tigrBlitBatch(Tigr *dest, Tigr *src, const TigrSprite *sprites, int count);
+
+// Scales all of src into the dw*dh rect at dx/dy of dest, replacing what
+// was there. Whole-number factors repeat pixels, any other size is
+// filtered bilinearly.
+void tigrBlitScaled(Tigr *dest, Tigr *src, int dx, int dy, int dw, int dh);
+
+// Same as tigrBlitScaled, but only writes rows [y0, y1) of the scaled
+// rect, so threads can each take a band of one frame.
+void tigrBlitScaledRows(Tigr *dest, Tigr *src, int dx, int dy, int dw, int dh, int y0, int y1);
+
+// Converts a bitmap to premultiplied alpha (once, later calls do nothing).
+// Blends from a premultiplied source use the cheaper dest*(1-a) + src form
+// and skip fully transparent pixels with a single compare. The destination
+// is expected to be opaque or premultiplied itself. Colors passed to the
+// drawing functions stay non-premultiplied either way.
+void tigrPremultiply(Tigr *bmp);
+
 // Helper for making colors.
 TIGR_INLINE TPixel tigrRGB(unsigned char r, unsigned char g, unsigned char b)
 {
@@ -157,6 +208,10 @@ int tigrTextHeight(TigrFont *font, const char *text);
 // The built-in font.
 extern TigrFont *tfont;
 
+// Converts a font's bitmap to premultiplied alpha, loading the built-in
+// font first if it hasn't been used yet.
+void tigrPremultiplyFont(TigrFont *font);
+
 
 // User Input -------------------------------------------------------------
 
@@ -186,6 +241,54 @@ int tigrKeyHeld(Tigr *bmp, int key);
 int tigrReadChar(Tigr *bmp);
 
 
+#ifdef TIGR_HEADLESS
+// Headless windows -------------------------------------------------------
+
+// tigrWindow returns an off-screen bitmap. Each tigrUpdate publishes it to
+// the sinks set up below, and input comes from a script instead of a user.
+
+// Input of a headless window, for the script to fill in.
+typedef struct {
+	int frame;			// tigrUpdate calls so far
+	int mouseX, mouseY, mouseButtons;
+	char keys[256];		// non-zero while a key is held
+	int lastChar;		// character typed since the last tigrUpdate, or 0
+	int closed;			// makes tigrClosed return non-zero once
+} TigrInput;
+
+// Runs once from tigrHeadlessInput and then after every tigrUpdate, and
+// sets the input seen until the next tigrUpdate.
+typedef void (*TigrInputScript)(Tigr *bmp, TigrInput *input, void *userdata);
+void tigrHeadlessInput(Tigr *bmp, TigrInputScript script, void *userdata);
+
+// Keeps the last 'frames' published frames in memory. Age 0 is the newest,
+// returns NULL for frames that aren't kept.
+void tigrHeadlessRing(Tigr *bmp, int frames);
+Tigr *tigrHeadlessFrame(Tigr *bmp, int age);
+
+// Start of the shared-memory segment written by tigrHeadlessShm. The newest
+// frame follows it as h rows of w pixels. sequence is odd while a frame is
+// being written; readers retry when it changed during their copy.
+typedef struct {
+	unsigned magic;		// TIGR_SHM_MAGIC
+	unsigned width, height;
+	unsigned sequence;
+	unsigned frame;
+	unsigned reserved[11];
+} TigrShmHeader;
+
+#define TIGR_SHM_MAGIC 0x52474954	// "TIGR"
+
+// Publishes every frame to the POSIX shared-memory object 'name' ("/tigr").
+// Returns zero on failure.
+int tigrHeadlessShm(Tigr *bmp, const char *name);
+
+// Appends every frame to a file as raw BGRA rows, which ffmpeg reads
+// with -f rawvideo -pix_fmt bgra. Returns zero on failure.
+int tigrHeadlessFile(Tigr *bmp, const char *fileName);
+
+#endif
+
 // Bitmap I/O -------------------------------------------------------------
 
 // Loads a PNG, from either a file or memory. (fileName is UTF-8)
@@ -197,6 +300,32 @@ Tigr *tigrLoadImageMem(const void *data, int length);
 // On error, returns zero and sets errno.
 int tigrSaveImage(const char *fileName, Tigr *bmp);
 
+// PNG encoder settings. level trades speed for size like zlib's: 0 stores
+// the pixels uncompressed, 1 is the fastest that compresses, 9 the smallest.
+typedef struct {
+	int level;
+} TigrSaveOptions;
+
+// tigrSaveImage with explicit settings. NULL options picks level 6.
+int tigrSaveImageEx(const char *fileName, Tigr *bmp, const TigrSaveOptions *options);
+
+// Encodes a PNG into memory, for pipes, sockets or custom storage. Returns
+// a buffer to release with free() and sets *length to its size. On error,
+// returns NULL and sets errno.
+void *tigrSaveImageMem(Tigr *bmp, const TigrSaveOptions *options, int *length);
+
+// Encodes one PNG on several threads. tigrSaveBegin splits the rows into
+// up to 'segments' groups. tigrSaveSegment filters and compresses one group
+// and can run on any thread, each index exactly once. Matches still reach
+// into the 32K of image before a group. tigrSaveEnd joins the groups into
+// a single PNG, frees the job and returns like tigrSaveImageMem. bmp must
+// not change until the last tigrSaveSegment has returned.
+typedef struct TigrSaveJob TigrSaveJob;
+TigrSaveJob *tigrSaveBegin(Tigr *bmp, const TigrSaveOptions *options, int segments);
+int tigrSaveSegments(TigrSaveJob *job);
+void tigrSaveSegment(TigrSaveJob *job, int index);
+void *tigrSaveEnd(TigrSaveJob *job, int *length);
+
 
 // Helpers ----------------------------------------------------------------
 
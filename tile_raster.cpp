@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "tile_raster.h"
+
+
+namespace {
+    // Inclusive pixel bounds a command can touch.
+    void commandBounds(const tile_command_t &c, int &min_x, int &min_y, int &max_x, int &max_y) {
+        if (c.type == tile_line) {
+            min_x = std::min(c.x1, c.x2);
+            min_y = std::min(c.y1, c.y2);
+            max_x = std::max(c.x1, c.x2);
+            max_y = std::max(c.y1, c.y2);
+            return;
+        }
+
+        min_x = c.x1;
+        min_y = c.y1;
+        max_x = c.x2 - 1;
+        max_y = c.y2 - 1;
+    }
+
+    void binCommands(tile_raster_t &raster, int worker, int begin, int end) {
+        auto &bins = raster.bins[worker];
+        for (auto &bin : bins) {
+            bin.clear();
+        }
+
+        const int width = raster.target->w;
+        const int height = raster.target->h;
+        const int size = raster.tile_size;
+
+        for (int i = begin; i < end; i += 1) {
+            int min_x, min_y, max_x, max_y;
+            commandBounds(raster.commands[i], min_x, min_y, max_x, max_y);
+
+            min_x = std::max(min_x, 0);
+            min_y = std::max(min_y, 0);
+            max_x = std::min(max_x, width - 1);
+            max_y = std::min(max_y, height - 1);
+            if (min_x > max_x || min_y > max_y) {
+                continue;
+            }
+
+            for (int ty = min_y / size; ty <= max_y / size; ty += 1) {
+                for (int tx = min_x / size; tx <= max_x / size; tx += 1) {
+                    bins[ty * raster.columns + tx].push_back(i);
+                }
+            }
+        }
+    }
+
+    void runCommand(Tigr *tile, const tile_command_t &c, int ox, int oy) {
+        switch (c.type) {
+            case tile_fill: {
+                const TigrRect rect {c.x1 - ox, c.y1 - oy, c.x2 - c.x1, c.y2 - c.y1, c.color};
+                tigrFillRects(tile, &rect, 1);
+                break;
+            }
+            case tile_line:
+                tigrLine(tile, c.x1 - ox, c.y1 - oy, c.x2 - ox, c.y2 - oy, c.color);
+                break;
+            case tile_blit:
+                tigrBlit(tile, c.src, c.x1 - ox, c.y1 - oy, c.sx, c.sy, c.x2 - c.x1, c.y2 - c.y1);
+                break;
+            case tile_blit_tint:
+                tigrBlitTint(tile, c.src, c.x1 - ox, c.y1 - oy, c.sx, c.sy, c.x2 - c.x1, c.y2 - c.y1, c.color);
+                break;
+        }
+    }
+
+    void rasterizeTile(tile_raster_t &raster, int worker, int tile_index) {
+        auto &buffer = raster.buffers[worker];
+        Tigr *target = raster.target;
+
+        const int size = raster.tile_size;
+        const int ox = (tile_index % raster.columns) * size;
+        const int oy = (tile_index / raster.columns) * size;
+        const int w = std::min(size, target->w - ox);
+        const int h = std::min(size, target->h - oy);
+
+        bool empty = true;
+        for (auto &bins : raster.bins) {
+            empty = empty && bins[tile_index].empty();
+        }
+        if (empty) {
+            return;
+        }
+
+        for (int y = 0; y < h; y += 1) {
+            std::memcpy(&buffer[y * size], &target->pix[(oy + y) * target->stride + ox], w * sizeof(TPixel));
+        }
+
+        // A view of the local buffer, so tigr's own clipping keeps every
+        // primitive inside this tile. Rows keep the full tile pitch.
+        Tigr tile {};
+        tile.w = w;
+        tile.h = h;
+        tile.stride = size;
+        tile.pix = buffer.data();
+        tile.premultiplied = target->premultiplied;
+
+        for (auto &bins : raster.bins) {
+            for (int index : bins[tile_index]) {
+                runCommand(&tile, raster.commands[index], ox, oy);
+            }
+        }
+
+        for (int y = 0; y < h; y += 1) {
+            std::memcpy(&target->pix[(oy + y) * target->stride + ox], &buffer[y * size], w * sizeof(TPixel));
+        }
+    }
+
+    void addCommand(tile_raster_t &raster, int type, int x1, int y1, int x2, int y2, TPixel color,
+                    Tigr *src = nullptr, int sx = 0, int sy = 0) {
+        tile_command_t c;
+        c.type = type;
+        c.x1 = x1;
+        c.y1 = y1;
+        c.x2 = x2;
+        c.y2 = y2;
+        c.sx = sx;
+        c.sy = sy;
+        c.color = color;
+        c.src = src;
+        raster.commands.push_back(c);
+    }
+}
+
+void initTileRaster(tile_raster_t &raster, int threads, int tile_size) {
+    threads = std::max(threads, 1);
+
+    raster.tile_size = tile_size;
+    raster.bins.assign(threads, {});
+    raster.buffers.assign(threads, std::vector<TPixel>(tile_size * tile_size));
+
+    startWorkers(raster.pool, threads);
+}
+
+void freeTileRaster(tile_raster_t &raster) {
+    stopWorkers(raster.pool);
+
+    raster.bins.clear();
+    raster.buffers.clear();
+    raster.commands.clear();
+    raster.target = nullptr;
+}
+
+void beginTiles(tile_raster_t &raster, Tigr *target) {
+    raster.target = target;
+    raster.columns = (target->w + raster.tile_size - 1) / raster.tile_size;
+    raster.rows = (target->h + raster.tile_size - 1) / raster.tile_size;
+    raster.commands.clear();
+
+    for (auto &bins : raster.bins) {
+        bins.resize(raster.columns * raster.rows);
+    }
+}
+
+void tileFill(tile_raster_t &raster, int x, int y, int w, int h, TPixel color) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    addCommand(raster, tile_fill, x, y, x + w, y + h, color);
+}
+
+void tileLine(tile_raster_t &raster, int x0, int y0, int x1, int y1, TPixel color) {
+    addCommand(raster, tile_line, x0, y0, x1, y1, color);
+}
+
+void tileBlit(tile_raster_t &raster, Tigr *src, int dx, int dy, int sx, int sy, int w, int h) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    addCommand(raster, tile_blit, dx, dy, dx + w, dy + h, TPixel {}, src, sx, sy);
+}
+
+void tileBlitTint(tile_raster_t &raster, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    addCommand(raster, tile_blit_tint, dx, dy, dx + w, dy + h, tint, src, sx, sy);
+}
+
+void flushTiles(tile_raster_t &raster) {
+    if (!raster.target || raster.commands.empty()) {
+        return;
+    }
+
+    const int workers = raster.pool.workerCount();
+    const int count = int(raster.commands.size());
+    const int tiles = raster.columns * raster.rows;
+
+    // Each worker bins a contiguous slice of the commands. Walking the
+    // workers' bins in order afterwards keeps submission order per tile.
+    runOnWorkers(raster.pool, [&raster, workers, count] (int worker) {
+        const int begin = int((long long)count * worker / workers);
+        const int end = int((long long)count * (worker + 1) / workers);
+        binCommands(raster, worker, begin, end);
+    });
+
+    std::atomic<int> next {0};
+    runOnWorkers(raster.pool, [&raster, &next, tiles] (int worker) {
+        for (int tile = next++; tile < tiles; tile = next++) {
+            rasterizeTile(raster, worker, tile);
+        }
+    });
+
+    raster.commands.clear();
+}
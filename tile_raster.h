@@ -0,0 +1,61 @@
+#ifndef __TILE_RASTER_H__
+#define __TILE_RASTER_H__
+
+#include <vector>
+
+#include "tigr.h"
+#include "workers.h"
+
+
+enum tile_command_type_t {
+    tile_fill,
+    tile_line,
+    tile_blit,
+    tile_blit_tint,
+};
+
+struct tile_command_t {
+    int type {tile_fill};
+    int x1 {0};       // fill/blit: destination rect [x1, x2) x [y1, y2)
+    int y1 {0};       // line: endpoints (x1, y1) and (x2, y2)
+    int x2 {0};
+    int y2 {0};
+    int sx {0};       // blit source position
+    int sy {0};
+    TPixel color {};  // fill/line color, blit tint
+    Tigr *src {nullptr};
+};
+
+// Records draw commands for a target bitmap, bins them into screen tiles and
+// rasterizes each tile on a worker thread into a small local buffer with the
+// regular tigr primitives. Commands run in submission order inside each tile,
+// so the result is the same as drawing them one by one on a single thread.
+struct tile_raster_t {
+    int tile_size {64};
+    int columns {0};
+    int rows {0};
+    Tigr *target {nullptr};
+
+    std::vector<tile_command_t> commands;
+    std::vector<std::vector<std::vector<int>>> bins; // [worker][tile] -> command indices
+    std::vector<std::vector<TPixel>> buffers;        // one tile buffer per worker
+
+    worker_pool_t pool;
+};
+
+void initTileRaster(tile_raster_t &raster, int threads, int tile_size = 64);
+void freeTileRaster(tile_raster_t &raster);
+
+void beginTiles(tile_raster_t &raster, Tigr *target);
+
+// Same semantics as tigrFillRects: translucent colors blend like tigrPlot.
+void tileFill(tile_raster_t &raster, int x, int y, int w, int h, TPixel color);
+void tileLine(tile_raster_t &raster, int x0, int y0, int x1, int y1, TPixel color);
+void tileBlit(tile_raster_t &raster, Tigr *src, int dx, int dy, int sx, int sy, int w, int h);
+void tileBlitTint(tile_raster_t &raster, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint);
+
+// Rasterizes everything recorded since beginTiles into the target.
+void flushTiles(tile_raster_t &raster);
+
+
+#endif//__TILE_RASTER_H__
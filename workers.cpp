@@ -0,0 +1,75 @@
+#include "workers.h"
+
+
+namespace {
+    void workerLoop(worker_pool_t &pool, int worker, int seen) {
+        for (;;) {
+            std::function<void(int)> job;
+            {
+                std::unique_lock<std::mutex> lock(pool.mutex);
+                pool.wake.wait(lock, [&pool, seen] {
+                    return pool.stopping || pool.generation != seen;
+                });
+
+                if (pool.stopping) {
+                    return;
+                }
+
+                seen = pool.generation;
+                job = pool.job;
+            }
+
+            job(worker);
+
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.pending -= 1;
+            if (pool.pending == 0) {
+                pool.done.notify_one();
+            }
+        }
+    }
+}
+
+void startWorkers(worker_pool_t &pool, int count) {
+    stopWorkers(pool);
+
+    pool.stopping = false;
+    for (int i = 1; i < count; i += 1) {
+        pool.threads.emplace_back(workerLoop, std::ref(pool), i, pool.generation);
+    }
+}
+
+void stopWorkers(worker_pool_t &pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+
+    for (auto &thread : pool.threads) {
+        thread.join();
+    }
+    pool.threads.clear();
+}
+
+void runOnWorkers(worker_pool_t &pool, const std::function<void(int)> &job) {
+    if (pool.threads.empty()) {
+        job(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.job = job;
+        pool.pending = int(pool.threads.size());
+        pool.generation += 1;
+    }
+    pool.wake.notify_all();
+
+    job(0);
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.done.wait(lock, [&pool] {
+        return pool.pending == 0;
+    });
+}
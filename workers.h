@@ -0,0 +1,36 @@
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A fixed set of threads that all run the same job and then wait for the
+// next one. The calling thread takes part as worker 0.
+struct worker_pool_t {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(int)> job;
+    int generation {0};
+    int pending {0};
+    bool stopping {false};
+
+    inline int workerCount() const {
+        return int(threads.size()) + 1;
+    }
+};
+
+// count is the total number of workers, including the calling thread.
+void startWorkers(worker_pool_t &pool, int count);
+void stopWorkers(worker_pool_t &pool);
+
+// Runs job(worker) once on every worker and returns when all have finished.
+void runOnWorkers(worker_pool_t &pool, const std::function<void(int)> &job);
+
+
+#endif//__WORKERS_H__
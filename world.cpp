@@ -0,0 +1,219 @@
+#include <algorithm>
+
+#include "world.h"
+#include "random.h"
+
+
+void fireMissile(world_t &world) {
+    const float life = 5.0f;
+    const float velocity = 150.0f;
+
+    const int center_x = world.width / 2;
+    const int center_y = world.height / 2;
+
+    const float rand_x = (float)randomInt(-center_x, center_x);
+    const float rand_y = (float)randomInt(-center_y, center_y);
+    const float rand_v = (float)randomInt(0, 20);
+    const float rand_l = float((randomInt(0, 100) / 100.0f) * 5.0f);
+
+    missile_t m;
+    m.position.set({float(center_x), float(center_y)});
+    m.life = life + rand_l;
+
+    m.velocity.set({rand_x, rand_y});
+    m.velocity.setDistance(velocity + rand_v);
+
+    world.missiles.push_back(m);
+}
+
+void explode(world_t &world, const vec2_t &pos, float dt) {
+    const int n = 16;
+    const float a = float(M_PI / n * 2);
+    const float a_offset = degToRad(float(randomInt(0, 360.0f / n)));
+    const float pow = 80.0f;
+
+    float r = 0.0f;
+    for (int i = 0; i < n; i += 1) {
+        const float p_offset = float(randomInt(0, 50));
+        const float r_life = 0.9f + ((randomInt(0, 100) / 100.0f) * 0.5f);
+
+        explosion_particle_t p;
+        p.position.set(pos);
+        p.velocity.fromAngle(r + a_offset);
+        p.velocity.setDistance(pow + p_offset);
+        p.life = r_life;
+
+        world.explosion_particles.push_back(p);
+        r += a;
+    }
+}
+
+void shakeScreen(world_t &world, float dt) {
+    world.screen_shake_life = 0.5f;
+    world.screen_shake_time = 0.0f;
+}
+
+bool updateMissile(world_t &world, missile_t &m, float dt) {
+    static const vec2_t drag {0.97f, 0.97f};
+    static const vec2_t gravity {0.0f, -480.0f};
+    static const float turn_radius = 200.0f;
+    static const float dead_time = 2.0f;
+
+    const int target_x = world.target_x;
+    const int target_y = world.target_y;
+
+    m.life -= dt;
+
+    if (m.life < -dead_time) {
+        explode(world, m.position, dt);
+        return false;
+    }
+
+    if (m.life <= 0.0f) {
+        m.velocity.multiply(drag);
+        m.velocity.subtract({gravity.x * dt, gravity.y * dt});
+        m.position.add({m.velocity.x * dt, m.velocity.y * dt});
+
+
+        return true;
+    }
+
+    m.target.set({float(target_x), float(target_y)});
+    m.position.add({m.velocity.x * dt, m.velocity.y * dt});
+
+    vec2_t diff;
+    diff.set(m.target);
+    diff.subtract(m.position);
+
+    if (diff.distanceSquared() <= 5.0f) {
+        world.hits += 1;
+        explode(world, m.position, dt);
+        shakeScreen(world, dt);
+        return false;
+    }
+
+    int r = randomInt(0, 4);
+    if (r == 0) {
+        const float r_time = 0.4f + ((randomInt(0, 100) / 100.0f) * 1.2f);
+
+        missile_particle_t p;
+        p.life = r_time;
+        p.position.set(m.position);
+
+        float particle_angle = radToDeg(m.velocity.angle());
+        particle_angle += float(randomInt(-3, 3));
+
+        p.velocity.fromAngle(degToRad(-particle_angle));
+        p.velocity.setDistance(32.0f * dt);
+
+        world.missile_particles.push_back(p);
+    }
+
+    const float target_angle = radToDeg(diff.angle());
+    float current_angle = radToDeg(m.velocity.angle());
+    float diff_angle = target_angle - current_angle;
+    while (diff_angle < 0) {
+        diff_angle += 360.0f;
+    }
+
+    if (diff_angle < 180.0f) {
+        current_angle += std::min(turn_radius * dt, diff_angle);
+    } else if (diff_angle > 180.0f) {
+        current_angle -= std::min(turn_radius * dt, 360.0f - diff_angle);
+    }
+
+    vec2_t new_vel;
+    new_vel.fromAngle(degToRad(current_angle));
+    new_vel.setDistance(m.velocity.distance());
+
+    m.velocity.set(new_vel);
+
+    return true;
+}
+
+void updateMissiles(world_t &world, float dt) {
+    auto it = std::remove_if(begin(world.missiles), end(world.missiles), [&world, dt] (missile_t &m) {
+        return !updateMissile(world, m, dt);
+    });
+
+    world.missiles.erase(it, end(world.missiles));
+
+    std::sort(begin(world.missiles), end(world.missiles), [] (const missile_t &m1, const missile_t &m2) {
+        return m1.position.x < m2.position.x;
+    });
+}
+
+bool updateMissileParticle(missile_particle_t &p, float dt) {
+    static const vec2_t force {0.0f, -200.0f};
+    static const vec2_t drag {0.98f, 0.98f};
+
+    p.time += dt;
+
+    if (p.time >= p.life) {
+        return false;
+    }
+
+    p.velocity.multiply(drag);
+    p.velocity.add({force.x * dt, force.y * dt});
+    p.position.add({p.velocity.x * dt, p.velocity.y * dt});
+
+    return true;
+}
+
+void updateMissileParticles(world_t &world, float dt) {
+    auto it = std::remove_if(begin(world.missile_particles), end(world.missile_particles),
+        [dt] (missile_particle_t &p) {
+            return !updateMissileParticle(p, dt);
+        });
+
+    world.missile_particles.erase(it, end(world.missile_particles));
+}
+
+bool updateExplosionParticle(explosion_particle_t &p, float dt) {
+    static const vec2_t force {0.0f, 100.0f};
+    static const vec2_t drag {0.99f, 0.99f};
+
+    p.time += dt;
+
+    if (p.time >= p.life) {
+        return false;
+    }
+
+    p.velocity.multiply(drag);
+    p.velocity.add({force.x * dt, force.y * dt});
+    p.position.add({p.velocity.x * dt, p.velocity.y * dt});
+
+    return true;
+}
+
+void updateExplosionParticles(world_t &world, float dt) {
+    auto it = std::remove_if(begin(world.explosion_particles), end(world.explosion_particles),
+        [dt] (explosion_particle_t &p) {
+            return !updateExplosionParticle(p, dt);
+        });
+
+    world.explosion_particles.erase(it, end(world.explosion_particles));
+}
+
+void updateScreenShake(world_t &world, float dt) {
+    static const float shake_amount = 5.0f;
+    static const float shake_speed = 48.0f;
+
+    if (world.screen_shake_time > world.screen_shake_life) {
+        world.screen_x = 0;
+        world.screen_y = 0;
+        return;
+    }
+
+    world.screen_shake_time += dt;
+    world.screen_y = int(std::sin(world.screen_shake_time * shake_speed) * shake_amount);
+    world.screen_x = int(std::cos(world.screen_shake_life * shake_speed * 2) * shake_amount / 4.0f);
+}
+
+void updateWorld(world_t &world, float dt) {
+    updateScreenShake(world, dt);
+
+    updateMissiles(world, dt);
+    updateMissileParticles(world, dt);
+    updateExplosionParticles(world, dt);
+}
@@ -0,0 +1,37 @@
+#ifndef __WORLD_H__
+#define __WORLD_H__
+
+#include <vector>
+
+#include "missiles.h"
+
+
+// Simulation state, independent of any window, input or audio backend.
+struct world_t {
+    int width {800};
+    int height {600};
+
+    // Where live missiles home in, normally the mouse cursor.
+    int target_x {0};
+    int target_y {0};
+
+    int screen_x {0};
+    int screen_y {0};
+
+    float screen_shake_time {0.0f};
+    float screen_shake_life {0.0f};
+
+    // Missiles that reached the target since the frontend last reset this,
+    // so it can play a sound for them.
+    int hits {0};
+
+    std::vector<missile_t> missiles;
+    std::vector<missile_particle_t> missile_particles;
+    std::vector<explosion_particle_t> explosion_particles;
+};
+
+void fireMissile(world_t &world);
+void updateWorld(world_t &world, float dt);
+
+
+#endif//__WORLD_H__
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <spdlog/spdlog.h>
+
+#include "tigr.h"
+
+
+// Opens a tigr X11 window and reads it back through a second connection to
+// check what tigrUpdate presents: the first full frame, a frame where only
+// some rows changed, and full redraws after the window is resized bigger
+// and smaller than the bitmap. Meant to run under Xvfb with a 24-bit
+// screen, once as is (MIT-SHM) and once with TIGR_NO_SHM=1 (XPutImage).
+//
+// usage: tigr-x11-smoke
+
+namespace {
+    const int bitmap_width {160};
+    const int bitmap_height {120};
+    const unsigned long marker {0xff00ff};
+
+    // What tigrUpdate lays out for a fixed-size TIGR_2X window.
+    struct layout_t {
+        bool viewable {false};
+        int width {0};
+        int height {0};
+        int scale {1};
+        int x {0};
+        int y {0};
+    };
+
+    layout_t layoutFor(Display *dpy, Window window, const Tigr *bmp) {
+        XWindowAttributes attributes;
+        XGetWindowAttributes(dpy, window, &attributes);
+
+        layout_t layout;
+        layout.viewable = attributes.map_state == IsViewable;
+        layout.width = attributes.width;
+        layout.height = attributes.height;
+        layout.scale = std::max(2, std::max(1, std::min(layout.width / bmp->w, layout.height / bmp->h)));
+        layout.x = (layout.width - bmp->w * layout.scale) / 2;
+        layout.y = (layout.height - bmp->h * layout.scale) / 2;
+        return layout;
+    }
+
+    void drawPattern(Tigr *bmp, int seed) {
+        for (int y = 0; y < bmp->h; y += 1) {
+            for (int x = 0; x < bmp->w; x += 1) {
+                bmp->pix[y * bmp->stride + x] = tigrRGB(x * 3 + seed, y * 5 + seed * 7, (x ^ y) + seed * 13);
+            }
+        }
+    }
+
+    // Compares the window with bmp, expecting background outside the bitmap
+    // and outside window rows [dirty_top, dirty_bottom).
+    bool windowMatches(Display *dpy, Window window, const Tigr *bmp, unsigned long background,
+                       int dirty_top, int dirty_bottom, bool report) {
+        const layout_t layout = layoutFor(dpy, window, bmp);
+        if (!layout.viewable) {
+            return false;
+        }
+
+        XImage *image = XGetImage(dpy, window, 0, 0, layout.width, layout.height, AllPlanes, ZPixmap);
+        if (!image) {
+            return false;
+        }
+
+        bool matches = true;
+        for (int y = 0; y < layout.height && matches; y += 1) {
+            for (int x = 0; x < layout.width; x += 1) {
+                const int bx = x - layout.x;
+                const int by = y - layout.y;
+                unsigned long expected = background;
+                if (bx >= 0 && by >= 0 && bx < bmp->w * layout.scale && by < bmp->h * layout.scale
+                    && y >= dirty_top && y < dirty_bottom) {
+                    const TPixel p = bmp->pix[(by / layout.scale) * bmp->stride + bx / layout.scale];
+                    expected = (unsigned long)p.r << 16 | (unsigned long)p.g << 8 | p.b;
+                }
+                if ((XGetPixel(image, x, y) & 0xffffff) != expected) {
+                    if (report) {
+                        spdlog::error("pixel {},{} is {:06x}, expected {:06x} ({}x{} window, scale {})", x, y,
+                                      XGetPixel(image, x, y) & 0xffffff, expected, layout.width, layout.height,
+                                      layout.scale);
+                    }
+                    matches = false;
+                    break;
+                }
+            }
+        }
+
+        XDestroyImage(image);
+        return matches;
+    }
+
+    // Keeps calling tigrUpdate until the server has shown what we expect.
+    bool waitForWindow(Display *dpy, Tigr *window, unsigned long background, int dirty_top, int dirty_bottom) {
+        const Window handle = Window(uintptr_t(window->handle));
+        for (int attempt = 0; attempt < 200; attempt += 1) {
+            tigrUpdate(window);
+            XSync(dpy, False);
+            if (windowMatches(dpy, handle, window, background, dirty_top, dirty_bottom, false)) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return windowMatches(dpy, handle, window, background, dirty_top, dirty_bottom, true);
+    }
+
+    // Covers the window with marker, changes bitmap rows [top, bottom) and
+    // checks that only their scaled rows were put.
+    bool checkDirtyRows(Display *dpy, Tigr *window, int top, int bottom, int seed) {
+        const Window handle = Window(uintptr_t(window->handle));
+        const layout_t layout = layoutFor(dpy, handle, window);
+
+        GC gc = XCreateGC(dpy, handle, 0, nullptr);
+        XSetForeground(dpy, gc, marker);
+        XFillRectangle(dpy, handle, gc, 0, 0, layout.width, layout.height);
+        XFreeGC(dpy, gc);
+        XSync(dpy, False);
+
+        Tigr *rows = tigrBitmap(window->w, bottom - top);
+        drawPattern(rows, seed);
+        tigrBlit(window, rows, 0, top, 0, 0, rows->w, rows->h);
+        tigrFree(rows);
+
+        return waitForWindow(dpy, window, marker, layout.y + top * layout.scale, layout.y + bottom * layout.scale);
+    }
+
+    bool checkResize(Display *dpy, Tigr *window, int width, int height) {
+        XResizeWindow(dpy, Window(uintptr_t(window->handle)), width, height);
+        XSync(dpy, False);
+        return waitForWindow(dpy, window, 0, 0, height);
+    }
+}
+
+int main() {
+    Display *dpy = XOpenDisplay(nullptr);
+    if (!dpy) {
+        spdlog::error("Can't open the X display");
+        return 1;
+    }
+
+    const bool shm = std::getenv("TIGR_NO_SHM") == nullptr;
+    if (shm && !XShmQueryExtension(dpy)) {
+        spdlog::error("The X server has no MIT-SHM, the shared memory path can't be tested");
+        XCloseDisplay(dpy);
+        return 1;
+    }
+    spdlog::info("presenting with {}", shm ? "MIT-SHM" : "XPutImage");
+
+    Tigr *window = tigrWindow(bitmap_width, bitmap_height, "tigr-x11-smoke", TIGR_2X);
+    drawPattern(window, 0);
+
+    bool ok = true;
+    // The Expose from mapping can arrive after the first frame is shown. It's
+    // queued by then, so one more update takes its full redraw out of the way.
+    if (!waitForWindow(dpy, window, 0, 0, INT32_MAX) || !waitForWindow(dpy, window, 0, 0, INT32_MAX)) {
+        spdlog::error("first frame wasn't presented");
+        ok = false;
+    }
+    if (ok && !checkDirtyRows(dpy, window, 40, 50, 1)) {
+        spdlog::error("changed rows weren't presented on their own");
+        ok = false;
+    }
+    if (ok && !checkResize(dpy, window, bitmap_width * 3 + 20, bitmap_height * 2 + 60)) {
+        spdlog::error("frame wasn't redrawn after growing the window");
+        ok = false;
+    }
+    if (ok && !checkDirtyRows(dpy, window, 0, 7, 2)) {
+        spdlog::error("changed rows weren't presented on their own after growing the window");
+        ok = false;
+    }
+    if (ok && !checkResize(dpy, window, bitmap_width + 40, bitmap_height + 30)) {
+        spdlog::error("frame wasn't redrawn after shrinking the window");
+        ok = false;
+    }
+    if (ok && !checkDirtyRows(dpy, window, 30, 40, 3)) {
+        spdlog::error("changed rows weren't presented on their own after shrinking the window");
+        ok = false;
+    }
+
+    tigrFree(window);
+    XCloseDisplay(dpy);
+
+    if (ok) {
+        spdlog::info("all checks passed");
+    }
+    return ok ? 0 : 1;
+}